@@ -0,0 +1,254 @@
+#pragma once
+/**
+ *  Adaptive mutex - spin first, sleep later.
+ *
+ *  std::mutex goes to the kernel as soon as the lock is taken, which costs two context switches even when the owner
+ *  would release it a few nanoseconds later. adaptive_mutex first spins with exponential backoff (pause instruction
+ *  between polls, so the spinning core doesnt flood the bus and lets its hyperthread sibling run) and only when the
+ *  lock stays busy it parks the thread on a futex (Drepper - "Futexes are tricky", mutex with 3 states).
+ *
+ *  Every lock counts its acquisitions, contended acquisitions and histogram of time spent waiting. Counters are
+ *  updated while the lock is held, so they cost no extra atomic read-modify-write. Named locks are registered in
+ *  lock_statistics and their counters are printed to stderr when the program exits.
+ */
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "cache_line.hpp"
+#include "futex.hpp"
+
+/// Hint to the cpu that we are busy waiting
+inline void cpu_relax()
+{
+#if defined(__SSE2__)
+    _mm_pause();
+#else
+    std::this_thread::yield();
+#endif
+}
+
+namespace lock_statistics
+{
+constexpr std::size_t histogram_buckets = 32; ///< bucket i counts waits in [2^i, 2^(i+1)) ns
+
+struct snapshot
+{
+    std::string name;
+    std::uint64_t acquisitions = 0;
+    std::uint64_t contended = 0;
+    std::array<std::uint64_t, histogram_buckets> wait_histogram{};
+
+    void merge(const snapshot& other)
+    {
+        acquisitions += other.acquisitions;
+        contended += other.contended;
+        for(std::size_t i = 0; i < histogram_buckets; ++i) { wait_histogram[i] += other.wait_histogram[i]; }
+    }
+};
+
+/// Counters of one lock. Written only by the lock owner, read by anyone (relaxed, may be slightly behind).
+class counters
+{
+private:
+    std::atomic<std::uint64_t> acquisitions{0};
+    std::atomic<std::uint64_t> contended{0};
+    std::array<std::atomic<std::uint64_t>, histogram_buckets> wait_histogram{};
+
+    /// lock is held, so plain load+store is enough
+    static void bump(std::atomic<std::uint64_t>& counter)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+public:
+    void record_uncontended() { bump(acquisitions); }
+
+    void record_contended(const std::uint64_t wait_ns)
+    {
+        bump(acquisitions);
+        bump(contended);
+        std::size_t bucket = 0;
+        for(std::uint64_t value = wait_ns; value > 1 && bucket + 1 < histogram_buckets; value >>= 1) { ++bucket; }
+        bump(wait_histogram[bucket]);
+    }
+
+    snapshot read(const std::string& name) const
+    {
+        snapshot result;
+        result.name = name;
+        result.acquisitions = acquisitions.load(std::memory_order_relaxed);
+        result.contended = contended.load(std::memory_order_relaxed);
+        for(std::size_t i = 0; i < histogram_buckets; ++i)
+        {
+            result.wait_histogram[i] = wait_histogram[i].load(std::memory_order_relaxed);
+        }
+        return result;
+    }
+};
+
+inline void print(std::ostream& os, const snapshot& s)
+{
+    os << s.name << ": acquisitions=" << s.acquisitions << " contended=" << s.contended;
+    if(s.acquisitions != 0) { os << " (" << std::setprecision(3) << 100. * s.contended / s.acquisitions << "%)"; }
+    os << "\n";
+    for(std::size_t i = 0; i < histogram_buckets; ++i)
+    {
+        if(s.wait_histogram[i] == 0) { continue; }
+        os << "    wait < " << std::setw(12) << (std::uint64_t(2) << i) << " ns: " << s.wait_histogram[i] << "\n";
+    }
+}
+
+/// Named locks alive and counters of destroyed ones (merged by name). Dumps everything at exit.
+class registry
+{
+private:
+    struct entry
+    {
+        const counters* lock_counters;
+        std::string name;
+    };
+
+    std::mutex m;
+    std::vector<entry> live;
+    std::vector<snapshot> retired;
+
+public:
+    static registry& instance()
+    {
+        static registry r;
+        return r;
+    }
+
+    ~registry()
+    {
+        dump(std::cerr);
+    }
+
+    void add(const counters* c, const char* name)
+    {
+        std::lock_guard<std::mutex> lock(m);
+        live.push_back(entry{c, name});
+    }
+
+    void remove(const counters* c)
+    {
+        std::lock_guard<std::mutex> lock(m);
+        for(auto it = live.begin(); it != live.end(); ++it)
+        {
+            if(it->lock_counters != c) { continue; }
+            const snapshot last = c->read(it->name);
+            auto same_name = retired.begin();
+            while(same_name != retired.end() && same_name->name != last.name) { ++same_name; }
+            if(same_name == retired.end()) { retired.push_back(last); }
+            else { same_name->merge(last); }
+            live.erase(it);
+            return;
+        }
+    }
+
+    void dump(std::ostream& os)
+    {
+        std::lock_guard<std::mutex> lock(m);
+        if(live.empty() && retired.empty()) { return; }
+        os << "--- lock statistics ---\n";
+        for(const snapshot& s : retired) { print(os, s); }
+        for(const entry& e : live) { print(os, e.lock_counters->read(e.name)); }
+        os.flush();
+    }
+};
+
+/// Prints counters of all named locks
+inline void dump(std::ostream& os = std::cerr)
+{
+    registry::instance().dump(os);
+}
+} ///< namespace lock_statistics
+
+class adaptive_mutex
+{
+private:
+    enum : int { unlocked = 0, locked = 1, locked_with_waiters = 2 };
+
+    static constexpr unsigned max_spin_rounds = 10; ///< backoff 1, 2, 4 ... 512 pauses before parking
+
+    alignas(cache_line_size) std::atomic<int> state;
+    lock_statistics::counters stats;
+    const bool registered;
+
+    bool try_acquire()
+    {
+        int expected = unlocked;
+        return state.compare_exchange_strong(expected, locked, std::memory_order_acquire, std::memory_order_relaxed);
+    }
+
+    void lock_contended()
+    {
+        const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        bool acquired = false;
+        for(unsigned round = 0; round < max_spin_rounds && not acquired; ++round)
+        {
+            for(unsigned i = 0; i < (1u << round); ++i) { cpu_relax(); }
+            acquired = state.load(std::memory_order_relaxed) == unlocked && try_acquire();
+        }
+        if(not acquired)
+        {
+            /// mark that someone sleeps, so unlock knows it has to wake us
+            while(state.exchange(locked_with_waiters, std::memory_order_acquire) != unlocked)
+            {
+                futex_wait(state, locked_with_waiters);
+            }
+        }
+        const std::uint64_t wait_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - begin).count();
+        stats.record_contended(wait_ns);
+    }
+
+public:
+    /// Named locks are reported by lock_statistics at exit
+    explicit adaptive_mutex(const char* name = nullptr) : state(unlocked), registered(name != nullptr)
+    {
+        if(registered) { lock_statistics::registry::instance().add(&stats, name); }
+    }
+    adaptive_mutex(const adaptive_mutex&) = delete;
+    adaptive_mutex& operator=(const adaptive_mutex&) = delete;
+    ~adaptive_mutex()
+    {
+        if(registered) { lock_statistics::registry::instance().remove(&stats); }
+    }
+
+    void lock()
+    {
+        if(try_acquire()) { stats.record_uncontended(); }
+        else { lock_contended(); }
+    }
+
+    bool try_lock()
+    {
+        if(not try_acquire()) { return false; }
+        stats.record_uncontended();
+        return true;
+    }
+
+    void unlock()
+    {
+        if(state.exchange(unlocked, std::memory_order_release) == locked_with_waiters) { futex_wake(state, 1); }
+    }
+
+    lock_statistics::snapshot statistics(const std::string& name = "") const
+    {
+        return stats.read(name);
+    }
+};
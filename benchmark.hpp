@@ -0,0 +1,412 @@
+#pragma once
+/**
+ *  Benchmark harness shared by the example mains.
+ *
+ *  Workloads replace sleep_for stubs. Sleep frees the core and wakes up with tens of microseconds of jitter, so it
+ *  hides every cache and cpu effect a benchmark wants to show.
+ *  - cpu_work:      chain of dependent xorshift steps - cant be vectorized or skipped by the compiler, touches no
+ *                   memory. cpu_work_for(duration) converts duration to a fixed step count calibrated once per
+ *                   process, so every repetition executes the same instructions.
+ *  - pointer_chase: walk of one random cycle through a buffer, every step is a dependent load from another cache
+ *                   line. Once the buffer is bigger than the caches each step costs a memory latency. walk() is
+ *                   const, so several threads can chase through one buffer.
+ *
+ *  harness runs every benchmark warmup times unmeasured, then repetitions times measured, and reports min, median,
+ *  p99 and throughput. Measuring thread can be pinned to one cpu. Command line of the example:
+ *      --repetitions=N --warmup=N --pin=CPU --format=text|csv|json --output=FILE
+ *  Text lines are printed to stdout as results come. CSV and JSON are written to FILE when the harness is destroyed,
+ *  so they never mix with what the example itself prints - without --output the harness falls back to text.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "cache_line.hpp"
+
+namespace bench
+{
+/// Keeps value (and computation leading to it) alive without storing it anywhere
+template<typename T>
+inline void do_not_optimize(const T& value)
+{
+#if defined(__GNUC__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const T* sink;
+    sink = &value;
+#endif
+}
+
+/// Cpus the process may run on (taskset, cpuset of a container), in ascending order. Never empty.
+inline std::vector<unsigned> allowed_cpus()
+{
+    std::vector<unsigned> cpus;
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if(sched_getaffinity(0, sizeof(set), &set) == 0)
+    {
+        for(unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        {
+            if(CPU_ISSET(cpu, &set)) { cpus.push_back(cpu); }
+        }
+    }
+#endif
+    if(cpus.empty())
+    {
+        for(unsigned cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu) { cpus.push_back(cpu); }
+    }
+    return cpus;
+}
+
+/// Pins calling thread to cpu. Returns false where pinning is not supported or cpu is not allowed.
+inline bool pin_current_thread(const unsigned cpu)
+{
+#if defined(__linux__)
+    if(cpu >= CPU_SETSIZE) { return false; }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    static_cast<void>(cpu);
+    return false;
+#endif
+}
+
+inline std::uint64_t cpu_work(const std::uint64_t steps, std::uint64_t state = 0x9e3779b97f4a7c15ull)
+{
+    for(std::uint64_t i = 0; i < steps; ++i)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+    }
+    return state;
+}
+
+/// cpu_work steps per nanosecond, fastest of several rounds (slower ones were interrupted)
+class cpu_calibration
+{
+private:
+    double steps_per_ns;
+
+    cpu_calibration()
+    {
+        constexpr std::uint64_t steps = 1 << 18;
+        double best_ns = 0.;
+        for(int round = 0; round < 7; ++round)
+        {
+            const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            do_not_optimize(cpu_work(steps, round + 1));
+            const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+            if(round == 0 || ns < best_ns) { best_ns = ns; }
+        }
+        this->steps_per_ns = steps / std::max(best_ns, 1.);
+    }
+
+public:
+    static const cpu_calibration& instance()
+    {
+        static const cpu_calibration calibration;
+        return calibration;
+    }
+
+    std::uint64_t steps_for(const std::chrono::nanoseconds duration) const
+    {
+        return static_cast<std::uint64_t>(duration.count() * this->steps_per_ns);
+    }
+};
+
+/// Busy cpu work taking about duration. Returns its result, so callers can make it part of their data.
+inline std::uint64_t cpu_work_for(const std::chrono::nanoseconds duration, const std::uint64_t seed = 1)
+{
+    const std::uint64_t result = cpu_work(cpu_calibration::instance().steps_for(duration), seed);
+    do_not_optimize(result);
+    return result;
+}
+
+class pointer_chase
+{
+private:
+    struct alignas(cache_line_size) node
+    {
+        std::size_t next;
+    };
+
+    cache_aligned_vector<node> nodes;
+    std::size_t position;
+    double ns_per_step;
+
+public:
+    /// One random cycle (fixed seed) through all cache lines of the buffer
+    explicit pointer_chase(const std::size_t bytes, const std::uint32_t seed = 42) :
+        nodes(std::max<std::size_t>(bytes / sizeof(node), 2)),
+        position(0),
+        ns_per_step(0.)
+    {
+        std::vector<std::size_t> order(this->nodes.size());
+        std::iota(order.begin(), order.end(), std::size_t(0));
+        std::shuffle(order.begin(), order.end(), std::mt19937(seed));
+        for(std::size_t i = 0; i < order.size(); ++i) { this->nodes[order[i]].next = order[(i + 1) % order.size()]; }
+
+        const std::size_t steps = this->nodes.size() * 2;
+        this->run(steps); ///< warm up caches and tlb
+        const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        this->run(steps);
+        this->ns_per_step = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / steps;
+    }
+
+    std::size_t bytes() const { return this->nodes.size() * sizeof(node); }
+    double step_cost_ns() const { return this->ns_per_step; }
+
+    std::size_t size() const { return this->nodes.size(); }
+
+    /// steps dependent loads starting at node from (modulo size), returns node where the walk ended
+    std::size_t walk(const std::size_t from, const std::size_t steps) const
+    {
+        std::size_t p = from % this->nodes.size();
+        for(std::size_t i = 0; i < steps; ++i) { p = this->nodes[p].next; }
+        do_not_optimize(p);
+        return p;
+    }
+
+    /// Continues where the previous run stopped
+    std::size_t run(const std::size_t steps)
+    {
+        this->position = this->walk(this->position, steps);
+        return this->position;
+    }
+
+    std::size_t run_for(const std::chrono::nanoseconds duration)
+    {
+        return this->run(static_cast<std::size_t>(duration.count() / std::max(this->ns_per_step, 0.1)));
+    }
+};
+
+enum class output_format { text, csv, json };
+
+struct options
+{
+    unsigned warmup = 1;
+    unsigned repetitions = 5;
+    int pin_cpu = -1;       ///< -1 - measuring thread is not pinned
+    output_format format = output_format::text;
+    std::string output;     ///< csv/json file, required by those formats
+
+    /// Unknown arguments are ignored, so examples can have their own
+    static options from_args(const int argc, char** argv)
+    {
+        options result;
+        for(int i = 1; i < argc; ++i)
+        {
+            const std::string arg(argv[i]);
+            const auto value_of = [&arg](const std::string& key) -> const char* {
+                return arg.compare(0, key.size(), key) == 0 ? arg.c_str() + key.size() : nullptr;
+            };
+            if(const char* v = value_of("--warmup=")) { result.warmup = static_cast<unsigned>(std::atoi(v)); }
+            else if(const char* v = value_of("--repetitions=")) { result.repetitions = std::max(1, std::atoi(v)); }
+            else if(const char* v = value_of("--pin=")) { result.pin_cpu = std::atoi(v); }
+            else if(const char* v = value_of("--output=")) { result.output = v; }
+            else if(const char* v = value_of("--format="))
+            {
+                const std::string format(v);
+                result.format = format == "csv" ? output_format::csv
+                              : format == "json" ? output_format::json : output_format::text;
+            }
+        }
+        return result;
+    }
+};
+
+/// Upper bound of warm-up runs and repetitions for one benchmark, eg. known pathological case
+struct limits
+{
+    unsigned warmup;
+    unsigned repetitions;
+};
+
+struct statistics
+{
+    std::string name;
+    unsigned repetitions;
+    double min_ms;
+    double median_ms;
+    double p99_ms;
+    double mean_ms;
+    double items_per_second; ///< items / median time, 0 when benchmark has no item count
+};
+
+/// Nearest rank percentile of sorted samples
+inline double percentile(const std::vector<double>& sorted, const double p)
+{
+    const std::size_t rank = static_cast<std::size_t>(std::ceil(p / 100. * sorted.size()));
+    return sorted[std::min(sorted.size(), std::max<std::size_t>(rank, 1)) - 1];
+}
+
+inline statistics summarize(const std::string& name, std::vector<double> samples_ms, const double items)
+{
+    std::sort(samples_ms.begin(), samples_ms.end());
+    const std::size_t n = samples_ms.size();
+    statistics s;
+    s.name = name;
+    s.repetitions = static_cast<unsigned>(n);
+    s.min_ms = samples_ms.front();
+    s.median_ms = n % 2 == 1 ? samples_ms[n / 2] : (samples_ms[n / 2 - 1] + samples_ms[n / 2]) / 2.;
+    s.p99_ms = percentile(samples_ms, 99.);
+    s.mean_ms = std::accumulate(samples_ms.begin(), samples_ms.end(), 0.) / n;
+    s.items_per_second = items > 0. && s.median_ms > 0. ? items / (s.median_ms / 1000.) : 0.;
+    return s;
+}
+
+class harness
+{
+private:
+    const std::string suite;
+    const options opts;
+    std::vector<statistics> results;
+
+    static std::string quoted(const std::string& text, const char escape)
+    {
+        std::string result(1, '"');
+        for(const char c : text)
+        {
+            if(c == '"' || (escape == '\\' && c == '\\')) { result += escape; }
+            result += c;
+        }
+        return result + '"';
+    }
+
+    void print_text(const statistics& s) const
+    {
+        std::cout << "[" << this->suite << "] " << s.name << std::fixed << std::setprecision(3)
+                  << " median=" << s.median_ms << "[ms] p99=" << s.p99_ms << "[ms] min=" << s.min_ms << "[ms]";
+        if(s.items_per_second > 0.) { std::cout << " throughput=" << s.items_per_second / 1e6 << "[M/s]"; }
+        std::cout << " runs=" << s.repetitions << std::defaultfloat << std::endl;
+    }
+
+    void write_csv(std::ostream& os) const
+    {
+        os << "suite,name,repetitions,min_ms,median_ms,p99_ms,mean_ms,items_per_second\n";
+        for(const statistics& s : this->results)
+        {
+            os << quoted(this->suite, '"') << "," << quoted(s.name, '"') << "," << s.repetitions << "," << s.min_ms
+               << "," << s.median_ms << "," << s.p99_ms << "," << s.mean_ms << "," << s.items_per_second << "\n";
+        }
+    }
+
+    void write_json(std::ostream& os) const
+    {
+        os << "{\"suite\": " << quoted(this->suite, '\\') << ", \"results\": [";
+        for(std::size_t i = 0; i < this->results.size(); ++i)
+        {
+            const statistics& s = this->results[i];
+            os << (i == 0 ? "\n" : ",\n") << "  {\"name\": " << quoted(s.name, '\\')
+               << ", \"repetitions\": " << s.repetitions << ", \"min_ms\": " << s.min_ms
+               << ", \"median_ms\": " << s.median_ms << ", \"p99_ms\": " << s.p99_ms << ", \"mean_ms\": " << s.mean_ms
+               << ", \"items_per_second\": " << s.items_per_second << "}";
+        }
+        os << "\n]}\n";
+    }
+
+    static options checked(const std::string& suite, options opts)
+    {
+        if(opts.format != output_format::text && opts.output.empty())
+        {
+            std::cerr << "[" << suite << "] csv and json need --output=FILE, printing text" << std::endl;
+            opts.format = output_format::text;
+        }
+        return opts;
+    }
+
+public:
+    harness(const std::string& suite_, const options& opts_) : suite(suite_), opts(checked(suite_, opts_))
+    {
+        if(this->opts.pin_cpu >= 0 && not pin_current_thread(static_cast<unsigned>(this->opts.pin_cpu)))
+        {
+            std::cerr << "[" << this->suite << "] pinning to cpu " << this->opts.pin_cpu << " failed" << std::endl;
+        }
+        cpu_calibration::instance(); ///< calibrate now, not inside the first measured cpu_work_for
+    }
+    harness(const std::string& suite_, const int argc, char** argv) : harness(suite_, options::from_args(argc, argv)) {}
+    harness(const harness&) = delete;
+    harness& operator=(const harness&) = delete;
+
+    ~harness()
+    {
+        if(this->opts.format == output_format::text) { return; }
+        std::ofstream file(this->opts.output);
+        if(not file)
+        {
+            std::cerr << "[" << this->suite << "] cannot write " << this->opts.output << std::endl;
+            return;
+        }
+        if(this->opts.format == output_format::csv) { this->write_csv(file); }
+        else { this->write_json(file); }
+    }
+
+    const options& settings() const { return this->opts; }
+
+    /// setup runs before every run (warm-up too) and is not measured - eg. fresh copy of data to sort
+    template<typename Setup, typename Body>
+    const statistics& run_with_setup(const std::string& name, Setup setup, Body body, const double items,
+                                     const limits& cap)
+    {
+        const unsigned warmup = std::min(this->opts.warmup, cap.warmup);
+        const unsigned repetitions = std::max(1u, std::min(this->opts.repetitions, cap.repetitions));
+        for(unsigned i = 0; i < warmup; ++i)
+        {
+            setup();
+            body();
+        }
+        std::vector<double> samples_ms;
+        samples_ms.reserve(repetitions);
+        for(unsigned i = 0; i < repetitions; ++i)
+        {
+            setup();
+            const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            body();
+            samples_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count());
+        }
+        this->results.push_back(summarize(name, std::move(samples_ms), items));
+        if(this->opts.format == output_format::text) { this->print_text(this->results.back()); }
+        return this->results.back();
+    }
+
+    template<typename Setup, typename Body>
+    const statistics& run_with_setup(const std::string& name, Setup setup, Body body, const double items = 0.)
+    {
+        return this->run_with_setup(name, std::move(setup), std::move(body), items,
+                                    limits{this->opts.warmup, this->opts.repetitions});
+    }
+
+    /// items - work units done by one run of body (elements, messages ...), gives throughput
+    template<typename Body>
+    const statistics& run(const std::string& name, Body body, const double items = 0.)
+    {
+        return this->run_with_setup(name, []{}, std::move(body), items);
+    }
+
+    template<typename Body>
+    const statistics& run(const std::string& name, Body body, const double items, const limits& cap)
+    {
+        return this->run_with_setup(name, []{}, std::move(body), items, cap);
+    }
+};
+} ///< namespace bench
@@ -0,0 +1,72 @@
+#pragma once
+/**
+ *  Cache line helpers.
+ *  Two threads writing to different variables that live on the same cache line keep invalidating each others caches
+ *  (false sharing). Padding hot variables to whole cache lines removes that traffic.
+ */
+
+#include <cstddef>
+#include <limits>
+#include <new>
+#include <utility>
+#include <vector>
+
+/// std::hardware_destructive_interference_size is not provided by every standard library and gcc warns that its
+/// value may change between compiler versions, so use the common x86-64/ARM64 line size.
+constexpr std::size_t cache_line_size = 64;
+
+/// Value that occupies whole cache line(s), so it never shares a line with its neighbours
+template<typename T>
+struct alignas(cache_line_size) padded
+{
+    T value;
+
+    padded() : value() {}
+    template<typename... Args>
+    explicit padded(Args&&... args) : value(std::forward<Args>(args)...) {}
+
+    T& operator*() { return value; }
+    const T& operator*() const { return value; }
+    T* operator->() { return &value; }
+    const T* operator->() const { return &value; }
+};
+
+/// Allocator whose blocks start on a cache line and span whole lines, so no other allocation shares their first
+/// or last line
+template<typename T>
+struct cache_aligned_allocator
+{
+    using value_type = T;
+
+    static constexpr std::size_t alignment = alignof(T) > cache_line_size ? alignof(T) : cache_line_size;
+
+    cache_aligned_allocator() noexcept = default;
+    template<typename U>
+    cache_aligned_allocator(const cache_aligned_allocator<U>&) noexcept {}
+
+    static std::size_t bytes_for(const std::size_t count)
+    {
+        if(count > (std::numeric_limits<std::size_t>::max() - alignment) / sizeof(T)) { throw std::bad_array_new_length(); }
+        return (count * sizeof(T) + alignment - 1) / alignment * alignment;
+    }
+
+    T* allocate(const std::size_t count)
+    {
+        return static_cast<T*>(::operator new(bytes_for(count), std::align_val_t(alignment)));
+    }
+
+    void deallocate(T* p, const std::size_t count) noexcept
+    {
+        ::operator delete(p, bytes_for(count), std::align_val_t(alignment));
+    }
+
+    template<typename U>
+    bool operator==(const cache_aligned_allocator<U>&) const noexcept { return true; }
+    template<typename U>
+    bool operator!=(const cache_aligned_allocator<U>&) const noexcept { return false; }
+};
+
+/// Vector in its own cache lines. cache_aligned_vector<padded<T>> gives every element (eg. per thread
+/// statistics) its own line.
+template<typename T>
+using cache_aligned_vector = std::vector<T, cache_aligned_allocator<T>>;
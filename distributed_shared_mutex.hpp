@@ -0,0 +1,154 @@
+#pragma once
+/**
+ *  Reader-biased shared mutex with distributed reader counters.
+ *
+ *  std::shared_mutex keeps one reader count, so every lock_shared/unlock_shared writes the same cache line and
+ *  readers on different cores keep stealing it from each other - read throughput drops as cores are added.
+ *  Here every thread is bound to one of many cache line padded reader slots. Reader touches only its own slot and
+ *  reads the writer flag (which stays shared in all caches while there is no writer). Writer raises the flag and
+ *  waits until every slot drains, so writes are more expensive - use it for data that is read much more often
+ *  than written.
+ *
+ *  Meets SharedMutex requirements, so it works with std::shared_lock, std::unique_lock and std::lock_guard.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "cache_line.hpp"
+
+class distributed_shared_mutex
+{
+public:
+    enum class preference
+    {
+        readers, ///< writer backs off while readers are active, may starve under constant read load
+        writers  ///< waiting writer stops new readers, existing ones drain
+    };
+
+private:
+    const std::unique_ptr<padded<std::atomic<unsigned>>[]> reader_slots;
+    const unsigned slot_mask;
+    const preference mode;
+
+    padded<std::atomic<bool>> writer; ///< writer holds the lock or is draining readers
+    std::mutex writer_mutex;          ///< serializes writers
+
+    std::mutex wait_mutex;            ///< readers blocked by writer sleep here
+    std::condition_variable writer_done;
+
+    static unsigned round_up_to_power_of_two(const unsigned value)
+    {
+        unsigned result = 1;
+        while(result < value) { result <<= 1; }
+        return result;
+    }
+
+    /// Threads get slots round robin, thread keeps its slot for its whole life
+    std::atomic<unsigned>& my_slot() const
+    {
+        static std::atomic<unsigned> next_thread_index(0);
+        thread_local static const unsigned thread_index = next_thread_index++;
+        return *this->reader_slots[thread_index & this->slot_mask];
+    }
+
+    bool readers_drained() const
+    {
+        for(unsigned i = 0; i <= this->slot_mask; ++i)
+        {
+            if(this->reader_slots[i]->load() != 0) { return false; }
+        }
+        return true;
+    }
+
+    void wait_for_readers() const
+    {
+        while(not readers_drained()) { std::this_thread::yield(); }
+    }
+
+    void wait_for_writer()
+    {
+        std::unique_lock<std::mutex> lk(this->wait_mutex);
+        this->writer_done.wait(lk, [this]{ return not this->writer->load(); });
+    }
+
+    void release_writer()
+    {
+        this->writer->store(false);
+        {
+            std::lock_guard<std::mutex> lk(this->wait_mutex); ///< reader cannot miss notification between check and wait
+        }
+        this->writer_done.notify_all();
+    }
+
+public:
+    explicit distributed_shared_mutex(const preference mode_ = preference::readers,
+                                      const unsigned slots = std::thread::hardware_concurrency()) :
+        reader_slots(new padded<std::atomic<unsigned>>[round_up_to_power_of_two(std::max(slots, 1u))]),
+        slot_mask(round_up_to_power_of_two(std::max(slots, 1u)) - 1),
+        mode(mode_),
+        writer(false)
+    {
+        for(unsigned i = 0; i <= this->slot_mask; ++i) { this->reader_slots[i]->store(0); }
+    }
+    distributed_shared_mutex(const distributed_shared_mutex&) = delete;
+    distributed_shared_mutex& operator=(const distributed_shared_mutex&) = delete;
+
+    /// Reader announces itself in its slot first and checks writer flag second, writer does it the other way round
+    /// (both seq_cst), so at least one of them sees the other.
+    bool try_lock_shared()
+    {
+        std::atomic<unsigned>& slot = my_slot();
+        slot.fetch_add(1);
+        if(not this->writer->load()) { return true; }
+        slot.fetch_sub(1);
+        return false;
+    }
+
+    void lock_shared()
+    {
+        while(not try_lock_shared()) { wait_for_writer(); }
+    }
+
+    void unlock_shared()
+    {
+        my_slot().fetch_sub(1);
+    }
+
+    void lock()
+    {
+        this->writer_mutex.lock();
+        while(true)
+        {
+            this->writer->store(true);
+            if(this->mode == preference::writers || readers_drained())
+            {
+                wait_for_readers();
+                return;
+            }
+            /// let readers in, try again once they are gone
+            release_writer();
+            wait_for_readers();
+        }
+    }
+
+    bool try_lock()
+    {
+        if(not this->writer_mutex.try_lock()) { return false; }
+        this->writer->store(true);
+        if(readers_drained()) { return true; }
+        release_writer();
+        this->writer_mutex.unlock();
+        return false;
+    }
+
+    void unlock()
+    {
+        release_writer();
+        this->writer_mutex.unlock();
+    }
+};
@@ -1,42 +1,38 @@
 /**
  *  Cache optimization example
  *  Based on cpp conference: https://www.youtube.com/watch?v=Nz9SiF0QVKY
+ *  false_sharing namespace measures threads writing to adjacent versus cache line padded variables.
+ *  Needs C++20 (std::numbers).
  */
 
 #include<iostream>
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
 #include <thread>
 #include <memory>
+#include <numbers>
+#include <random>
 #include <vector>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
-#define DRAW_MS 2
-#define AREA_MS 12
-
-#define CIRCLE_DRAW_IMPL_MS DRAW_MS
-#define CIRCLE_AREA_IMPL_MS AREA_MS
-
-#define SQUARE_DRAW_IMPL_MS DRAW_MS
-#define SQUARE_AREA_IMPL_MS AREA_MS
+#include "benchmark.hpp"
+#include "poly_collection.hpp"
+#include "thread_pool.hpp"
 
 namespace common
 {
-struct ScopedTimerMs
-{
-    typedef std::chrono::steady_clock::time_point time_point;
-    const std::string name;
-    const time_point begin;
-
-    ScopedTimerMs(const std::string& name_) :
-        name(name_),
-        begin(std::chrono::steady_clock::now())
-    {}
-    ~ScopedTimerMs()
-    {
-        const time_point end = std::chrono::steady_clock::now();
-        std::cout << this->name << " time=" <<
-            std::chrono::duration_cast<std::chrono::milliseconds>(end - this->begin).count() << "[ms]" << std::endl;
-    }
-};
+/// Drawing itself is not implemented, it is simulated by calibrated cpu work (bench::cpu_work_for)
+constexpr std::chrono::nanoseconds circle_draw_cost(2000);
+constexpr std::chrono::nanoseconds square_draw_cost(2000);
 
 struct Point3D
 {
@@ -47,6 +43,10 @@ struct Color
 {
     int r, g, b;
 };
+
+/// Deterministic scene shared by all variants: position and radius (or side) of i-th shape
+inline Point3D position_of(const uint i) { return Point3D{float(i % 1000), float(i / 1000 % 1000), float(i % 7)}; }
+inline float extent_of(const uint i) { return 0.5f + float(i % 5) * 0.25f; }
 } ///< namespace common
 
 namespace cache_non_friendly
@@ -55,7 +55,7 @@ class Shape
 {
 public:
     Shape()=default;
-    ~Shape()=default;
+    virtual ~Shape()=default;
 
     virtual void draw() = 0;
     virtual float area() = 0;
@@ -67,23 +67,23 @@ protected:
     bool is_visible;
 };
 
-class Circle : public Shape
+/// final lets the compiler resolve calls through Circle& at compile time (poly_collection relies on it)
+class Circle final : public Shape
 {
 public:
     Circle()=default;
+    Circle(const common::Point3D& center_, const float radius_) : center(center_), radius(radius_) {}
     ~Circle()=default;
 
     void draw() override
     {
         // std::cout << "Circle::draw" << std::endl;
-        std::this_thread::sleep_for(std::chrono::milliseconds(CIRCLE_DRAW_IMPL_MS));
+        bench::cpu_work_for(common::circle_draw_cost);
     }
 
     float area() override
     {
-        // std::cout << "Circle::area" << std::endl;
-        std::this_thread::sleep_for(std::chrono::milliseconds(CIRCLE_AREA_IMPL_MS));
-        return 0.f;
+        return std::numbers::pi_v<float> * this->radius * this->radius;
     }
     typedef std::unique_ptr<Circle> Ptr;
 private:
@@ -91,23 +91,22 @@ private:
     float radius;
 };
 
-class Square : public Shape
+class Square final : public Shape
 {
 public:
     Square()=default;
+    Square(const common::Point3D& top_left_pnt_, const float side_) : top_left_pnt(top_left_pnt_), side(side_) {}
     ~Square()=default;
 
     void draw() override
     {
         // std::cout << "Square::draw" << std::endl;
-        std::this_thread::sleep_for(std::chrono::milliseconds(SQUARE_DRAW_IMPL_MS));
+        bench::cpu_work_for(common::square_draw_cost);
     }
 
     float area() override
     {
-        // std::cout << "Square::area" << std::endl;
-        std::this_thread::sleep_for(std::chrono::milliseconds(SQUARE_AREA_IMPL_MS));
-        return 0.f;
+        return this->side * this->side;
     }
     typedef std::unique_ptr<Square> Ptr;
 private:
@@ -115,7 +114,7 @@ private:
     float side;
 };
 
-void benchmark_fn(const uint size)
+void benchmark_fn(bench::harness& harness, const uint size)
 {
     using ShapePtr = Shape::Ptr;
     std::vector<ShapePtr> shapes;
@@ -123,28 +122,79 @@ void benchmark_fn(const uint size)
     for(uint i = 0; i < size; ++i)
     {
         ShapePtr shape;
-        if(i % 2 == 0) { shape = std::make_unique<Square>(); }
-        else { shape = std::make_unique<Circle>(); }
+        if(i % 2 == 0) { shape = std::make_unique<Square>(common::position_of(i), common::extent_of(i)); }
+        else { shape = std::make_unique<Circle>(common::position_of(i), common::extent_of(i)); }
         shapes.push_back(std::move(shape));
     }
 
     /// Measure time for each call
-    {
-        common::ScopedTimerMs timer("[cache_non_friendly] draw");
+    harness.run("cache_non_friendly draw", [&]{
         for(const auto& shape : shapes)
         {
             shape->draw();
         }
-    }
+    }, size);
 
-    {
-        common::ScopedTimerMs timer("[cache_non_friendly] area");
-        float total_area = 0;
+    float total_area = 0;
+    harness.run("cache_non_friendly area", [&]{
+        total_area = 0;
         for(const auto& shape : shapes)
         {
             total_area += shape->area();
         }
+    }, size);
+    std::cout << "[cache_non_friendly] total area=" << total_area << std::endl;
+}
+
+/// Same shapes behind pointers, in type segregated segments and in variants. Pointers get a random heap layout
+/// (shuffled allocation order), as they would in a long running program.
+void poly_collection_test(bench::harness& harness, const uint size)
+{
+    std::vector<Shape::Ptr> pointers(size);
+    std::vector<uint> allocation_order(size);
+    for(uint i = 0; i < size; ++i) { allocation_order[i] = i; }
+    std::mt19937 random(42);
+    std::shuffle(allocation_order.begin(), allocation_order.end(), random);
+
+    poly_collection<Shape, Circle, Square> segmented;
+    variant_collection<Circle, Square> variants;
+    segmented.reserve<Circle>(size / 2 + 1);
+    segmented.reserve<Square>(size / 2 + 1);
+    variants.reserve(size);
+    for(const uint i : allocation_order)
+    {
+        if(i % 2 == 0) { pointers[i] = std::make_unique<Square>(common::position_of(i), common::extent_of(i)); }
+        else { pointers[i] = std::make_unique<Circle>(common::position_of(i), common::extent_of(i)); }
+    }
+    for(uint i = 0; i < size; ++i)
+    {
+        if(i % 2 == 0)
+        {
+            segmented.emplace<Square>(common::position_of(i), common::extent_of(i));
+            variants.emplace<Square>(common::position_of(i), common::extent_of(i));
+        }
+        else
+        {
+            segmented.emplace<Circle>(common::position_of(i), common::extent_of(i));
+            variants.emplace<Circle>(common::position_of(i), common::extent_of(i));
+        }
     }
+
+    double pointer_area = 0., segmented_area = 0., variant_area = 0.;
+    harness.run("poly_collection area unique_ptr<Shape>", [&]{
+        pointer_area = 0.;
+        for(const Shape::Ptr& shape : pointers) { pointer_area += shape->area(); }
+    }, size);
+    harness.run("poly_collection area poly_collection", [&]{
+        segmented_area = 0.;
+        segmented.for_each([&segmented_area](auto& shape){ segmented_area += shape.area(); });
+    }, size);
+    harness.run("poly_collection area variant_collection", [&]{
+        variant_area = 0.;
+        variants.for_each([&variant_area](auto& shape){ variant_area += shape.area(); });
+    }, size);
+    std::cout << "[poly_collection] area pointers=" << pointer_area << " segmented=" << segmented_area
+              << " variants=" << variant_area << std::endl;
 }
 } ///< namespace cache_non_friendly
 
@@ -161,28 +211,84 @@ namespace cache_friendly
  *      - area: geometry of figure
  */
 
+/// Circle lies in xy plane, spans [x - radius, x + radius] and [y - radius, y + radius]
 struct CircleGeometry
 {
     common::Point3D center;
     float radius;
 };
 
+/// Square lies in xy plane, spans [x, x + side] and [y - side, y]
 struct SquareGeometry
 {
     common::Point3D top_left_pnt;
     float side;
 };
 
-struct ShapesGeometry
+struct BoundingBox
 {
-    std::vector<CircleGeometry> circles;
-    std::vector<SquareGeometry> squares;
-    ShapesGeometry(const uint size)
+    common::Point3D min, max;
+};
+
+/// Kernels over float columns. SSE2 processes four shapes per instruction, values are widened to double before
+/// squaring and summing, so millions of small areas dont lose precision and the scalar tail gives the same terms.
+namespace simd
+{
+inline double sum_of_squares(const float* first, const float* last)
+{
+    double total = 0.;
+#if defined(__SSE2__)
+    __m128d acc_0 = _mm_setzero_pd();
+    __m128d acc_1 = _mm_setzero_pd();
+    for(; last - first >= 4; first += 4)
     {
-        this->circles.reserve(size);
-        this->squares.reserve(size);
+        const __m128 values = _mm_loadu_ps(first);
+        const __m128d low = _mm_cvtps_pd(values);
+        const __m128d high = _mm_cvtps_pd(_mm_movehl_ps(values, values));
+        acc_0 = _mm_add_pd(acc_0, _mm_mul_pd(low, low));
+        acc_1 = _mm_add_pd(acc_1, _mm_mul_pd(high, high));
     }
-};
+    alignas(16) double lanes[2];
+    _mm_store_pd(lanes, _mm_add_pd(acc_0, acc_1));
+    total = lanes[0] + lanes[1];
+#endif
+    for(; first != last; ++first) { total += double(*first) * *first; }
+    return total;
+}
+
+/// Extends [min, max] by position[i] + low * extent[i] and position[i] + high * extent[i]
+inline void extend_bounds(const float* position, const float* extent, const std::size_t count,
+                          const float low, const float high, float& min, float& max)
+{
+    std::size_t i = 0;
+#if defined(__SSE2__)
+    if(count >= 4)
+    {
+        const __m128 low_4 = _mm_set1_ps(low);
+        const __m128 high_4 = _mm_set1_ps(high);
+        __m128 min_4 = _mm_set1_ps(min);
+        __m128 max_4 = _mm_set1_ps(max);
+        for(; i + 4 <= count; i += 4)
+        {
+            const __m128 p = _mm_loadu_ps(position + i);
+            const __m128 e = _mm_loadu_ps(extent + i);
+            min_4 = _mm_min_ps(min_4, _mm_add_ps(p, _mm_mul_ps(low_4, e)));
+            max_4 = _mm_max_ps(max_4, _mm_add_ps(p, _mm_mul_ps(high_4, e)));
+        }
+        alignas(16) float lanes[4];
+        _mm_store_ps(lanes, min_4);
+        min = std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+        _mm_store_ps(lanes, max_4);
+        max = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+    }
+#endif
+    for(; i < count; ++i)
+    {
+        min = std::min(min, position[i] + low * extent[i]);
+        max = std::max(max, position[i] + high * extent[i]);
+    }
+}
+} ///< namespace simd
 
 enum class ShapeKind : int8_t
 {
@@ -190,15 +296,163 @@ enum class ShapeKind : int8_t
     Square
 };
 
+/// Dense index of a shape in the columns of its kind. Valid only until next add/remove.
 struct ShapeID
 {
     ShapeKind kind;
     std::size_t index;
 };
 
+/// Stable reference to a shape. Removal moves shapes inside columns, so handle points to a slot which knows the
+/// current index, and generation tells whether the slot still belongs to the shape the handle was made for.
+struct ShapeHandle
+{
+    std::uint32_t slot = UINT32_MAX;
+    std::uint32_t generation = 0;
+};
+
+/// Structure of arrays - each attribute in its own contiguous column, so a kernel reads only what it needs
+/// and whole cache lines of it
+struct CircleColumns
+{
+    std::vector<float> x, y, z, radius;
+    std::vector<std::uint32_t> slot; ///< owning slot, to update it when the circle moves
+
+    std::size_t size() const { return this->slot.size(); }
+    std::array<std::vector<float>*, 4> floats() { return {&this->x, &this->y, &this->z, &this->radius}; }
+};
+
+struct SquareColumns
+{
+    std::vector<float> x, y, z, side;
+    std::vector<std::uint32_t> slot;
+
+    std::size_t size() const { return this->slot.size(); }
+    std::array<std::vector<float>*, 4> floats() { return {&this->x, &this->y, &this->z, &this->side}; }
+};
+
+/// Entity store of all shape geometry. Columns are public for kernels, but change them only via add/remove.
+class ShapesGeometry
+{
+public:
+    CircleColumns circles;
+    SquareColumns squares;
+
+    ShapesGeometry(const uint size)
+    {
+        for(std::vector<float>* column : this->circles.floats()) { column->reserve(size); }
+        for(std::vector<float>* column : this->squares.floats()) { column->reserve(size); }
+        this->circles.slot.reserve(size);
+        this->squares.slot.reserve(size);
+        this->slots.reserve(2 * size);
+    }
+
+    ShapeHandle add_circle(const CircleGeometry& circle)
+    {
+        const ShapeHandle handle = this->allocate_slot(ShapeKind::Circle, this->circles.size());
+        append(this->circles, {circle.center.x, circle.center.y, circle.center.z, circle.radius}, handle.slot);
+        return handle;
+    }
+
+    ShapeHandle add_square(const SquareGeometry& square)
+    {
+        const ShapeHandle handle = this->allocate_slot(ShapeKind::Square, this->squares.size());
+        const common::Point3D& p = square.top_left_pnt;
+        append(this->squares, {p.x, p.y, p.z, square.side}, handle.slot);
+        return handle;
+    }
+
+    bool alive(const ShapeHandle handle) const
+    {
+        return handle.slot < this->slots.size() && this->slots[handle.slot].generation == handle.generation;
+    }
+
+    ShapeID locate(const ShapeHandle handle) const
+    {
+        const slot_entry& entry = this->slots.at(handle.slot);
+        if(entry.generation != handle.generation) { throw std::out_of_range("stale shape handle"); }
+        return ShapeID{entry.kind, entry.index};
+    }
+
+    /// Swap-and-pop: last shape of the same kind fills the hole, so columns stay dense. Stale handle is ignored.
+    bool remove(const ShapeHandle handle)
+    {
+        if(not this->alive(handle)) { return false; }
+        slot_entry& entry = this->slots[handle.slot];
+        const std::uint32_t moved_slot = entry.kind == ShapeKind::Circle ? swap_and_pop(this->circles, entry.index)
+                                                                         : swap_and_pop(this->squares, entry.index);
+        if(moved_slot != handle.slot) { this->slots[moved_slot].index = entry.index; }
+        ++entry.generation;
+        entry.index = this->free_head;
+        this->free_head = handle.slot;
+        return true;
+    }
+
+    CircleGeometry circle(const std::size_t i) const
+    {
+        return CircleGeometry{{this->circles.x[i], this->circles.y[i], this->circles.z[i]}, this->circles.radius[i]};
+    }
+
+    SquareGeometry square(const std::size_t i) const
+    {
+        return SquareGeometry{{this->squares.x[i], this->squares.y[i], this->squares.z[i]}, this->squares.side[i]};
+    }
+
+    std::size_t size() const { return this->circles.size() + this->squares.size(); }
+
+private:
+    struct slot_entry
+    {
+        ShapeKind kind;
+        std::uint32_t generation;
+        std::uint32_t index; ///< dense index when alive, next free slot otherwise
+    };
+
+    std::vector<slot_entry> slots;
+    std::uint32_t free_head = UINT32_MAX;
+
+    ShapeHandle allocate_slot(const ShapeKind kind, const std::size_t index)
+    {
+        std::uint32_t slot = this->free_head;
+        if(slot == UINT32_MAX)
+        {
+            slot = static_cast<std::uint32_t>(this->slots.size());
+            this->slots.push_back(slot_entry{kind, 0, 0});
+        }
+        else { this->free_head = this->slots[slot].index; }
+        slot_entry& entry = this->slots[slot];
+        entry.kind = kind;
+        entry.index = static_cast<std::uint32_t>(index);
+        return ShapeHandle{slot, entry.generation};
+    }
+
+    template<typename Columns>
+    static void append(Columns& columns, const std::array<float, 4>& values, const std::uint32_t slot)
+    {
+        const std::array<std::vector<float>*, 4> floats = columns.floats();
+        for(std::size_t c = 0; c < floats.size(); ++c) { floats[c]->push_back(values[c]); }
+        columns.slot.push_back(slot);
+    }
+
+    /// Returns slot of the element which now lives at index
+    template<typename Columns>
+    static std::uint32_t swap_and_pop(Columns& columns, const std::size_t index)
+    {
+        for(std::vector<float>* column : columns.floats())
+        {
+            (*column)[index] = column->back();
+            column->pop_back();
+        }
+        const std::uint32_t moved_slot = columns.slot.back();
+        columns.slot[index] = moved_slot;
+        columns.slot.pop_back();
+        return moved_slot;
+    }
+};
+
 struct ShapeRender
 {
-    using shape = std::pair<ShapeID, common::Color>;
+    using shape = std::pair<ShapeHandle, common::Color>;
     std::vector<shape> visible;
     ShapeRender(const uint size)
     {
@@ -208,79 +462,518 @@ struct ShapeRender
 
 void draw(const ShapeRender& render, const ShapesGeometry& geometry)
 {
-    common::ScopedTimerMs timer("[cache_friendly] draw");
     for(const auto& shape : render.visible)
     {
-        if(shape.first.kind == ShapeKind::Circle)
+        const ShapeID id = geometry.locate(shape.first);
+        if(id.kind == ShapeKind::Circle)
         {
-            // draw_circle(geometry.circles[shape.first.id.index], color);
-            std::this_thread::sleep_for(std::chrono::milliseconds(CIRCLE_DRAW_IMPL_MS)); ///< implementation
+            // draw_circle(geometry.circle(id.index), color);
+            bench::cpu_work_for(common::circle_draw_cost); ///< implementation
         }
-        else if(shape.first.kind == ShapeKind::Square)
+        else if(id.kind == ShapeKind::Square)
         {
-            // draw_square(geometry.squares[shape.first.id.index], color);
-            std::this_thread::sleep_for(std::chrono::milliseconds(SQUARE_DRAW_IMPL_MS)); ///< implementation
+            // draw_square(geometry.square(id.index), color);
+            bench::cpu_work_for(common::square_draw_cost); ///< implementation
         }
     }
 
 }
 
+/// Total area of all shapes - one pass over radius and one over side column
+double area_kernel(const ShapesGeometry& geometry)
+{
+    const std::vector<float>& radius = geometry.circles.radius;
+    const std::vector<float>& side = geometry.squares.side;
+    return std::numbers::pi * simd::sum_of_squares(radius.data(), radius.data() + radius.size()) +
+           simd::sum_of_squares(side.data(), side.data() + side.size());
+}
+
 float area(const ShapesGeometry& geometry)
 {
-    common::ScopedTimerMs timer("[cache_friendly] area");
-    float total_area = 0.f;
-    for(const auto& circle : geometry.circles)
+    return static_cast<float>(area_kernel(geometry));
+}
+
+/// Box containing all shapes, each axis is a pass over position and extent column
+BoundingBox bounding_box(const ShapesGeometry& geometry)
+{
+    constexpr float inf = std::numeric_limits<float>::infinity();
+    float min[3] = {inf, inf, inf};
+    float max[3] = {-inf, -inf, -inf};
+    const CircleColumns& c = geometry.circles;
+    const SquareColumns& s = geometry.squares;
+    simd::extend_bounds(c.x.data(), c.radius.data(), c.size(), -1.f, 1.f, min[0], max[0]);
+    simd::extend_bounds(c.y.data(), c.radius.data(), c.size(), -1.f, 1.f, min[1], max[1]);
+    simd::extend_bounds(c.z.data(), c.radius.data(), c.size(), 0.f, 0.f, min[2], max[2]);
+    simd::extend_bounds(s.x.data(), s.side.data(), s.size(), 0.f, 1.f, min[0], max[0]);
+    simd::extend_bounds(s.y.data(), s.side.data(), s.size(), -1.f, 0.f, min[1], max[1]);
+    simd::extend_bounds(s.z.data(), s.side.data(), s.size(), 0.f, 0.f, min[2], max[2]);
+    return BoundingBox{{min[0], min[1], min[2]}, {max[0], max[1], max[2]}};
+}
+
+/// Axis aligned view volume, shape is visible when its bounding box overlaps it
+struct ViewBox
+{
+    common::Point3D min, max;
+};
+
+/// Shape projected to the screen
+struct DrawCommand
+{
+    float x, y, size;
+};
+
+/// Result of one frame. Vectors are kept between frames, so steady state frame doesnt allocate.
+struct FrameOutput
+{
+    std::vector<std::uint32_t> visible_circles; ///< dense indices, draw lists are split by kind so loops dont branch
+    std::vector<std::uint32_t> visible_squares;
+    std::vector<DrawCommand> circle_commands;
+    std::vector<DrawCommand> square_commands;
+};
+
+/// Frame update split into contiguous chunks, one per thread. Caller runs chunk 0 and then helps the pool.
+class FramePipeline
+{
+private:
+    struct chunk_buffers
     {
-        std::this_thread::sleep_for(std::chrono::milliseconds(CIRCLE_AREA_IMPL_MS)); ///< implementation
+        std::size_t circles_visible = 0; ///< counts from culling pass
+        std::size_t squares_visible = 0;
+        std::vector<DrawCommand> circle_commands;
+        std::vector<DrawCommand> square_commands;
+    };
+
+    thread_pool& pool;
+    const unsigned chunks;
+    std::vector<padded<chunk_buffers>> buffers; ///< per thread, padded so counters of neighbours dont share a line
+
+    static constexpr float focal_length = 100.f;
+
+    static std::pair<std::size_t, std::size_t> chunk_range(const std::size_t count, const unsigned chunk,
+                                                           const unsigned chunks)
+    {
+        return {count * chunk / chunks, count * (chunk + 1) / chunks};
     }
 
-    for(const auto& square : geometry.circles)
+    template<typename Func>
+    void for_each_chunk(Func f)
     {
-        std::this_thread::sleep_for(std::chrono::milliseconds(SQUARE_AREA_IMPL_MS)); ///< implementation
+        std::vector<task_future<void>> done;
+        done.reserve(this->chunks - 1);
+        for(unsigned chunk = 1; chunk < this->chunks; ++chunk)
+        {
+            done.push_back(this->pool.submit_task([&f, chunk]{ f(chunk); }));
+        }
+        f(0u);
+        for(task_future<void>& chunk_done : done)
+        {
+            this->pool.wait(chunk_done);
+            chunk_done.get();
+        }
     }
-    return total_area;
-}
 
-void benchmark_fn(const uint size)
+    /// Visible when [p + low * e, p + high * e] overlaps view on every axis. Branch free, so the loop vectorizes.
+    static bool overlaps(const ViewBox& view, const float x, const float y, const float z, const float e,
+                         const float low, const float high, const float low_y, const float high_y)
+    {
+        return (x + high * e >= view.min.x) & (x + low * e <= view.max.x) &
+               (y + high_y * e >= view.min.y) & (y + low_y * e <= view.max.y) &
+               (z >= view.min.z) & (z <= view.max.z);
+    }
+
+    /// Circles extend by radius on x and y, squares from top left to the right and down
+    static bool circle_visible(const ViewBox& view, const CircleColumns& c, const std::size_t i)
+    {
+        return overlaps(view, c.x[i], c.y[i], c.z[i], c.radius[i], -1.f, 1.f, -1.f, 1.f);
+    }
+    static bool square_visible(const ViewBox& view, const SquareColumns& s, const std::size_t i)
+    {
+        return overlaps(view, s.x[i], s.y[i], s.z[i], s.side[i], 0.f, 1.f, -1.f, 0.f);
+    }
+
+    template<typename Visible>
+    static std::size_t count_visible(const std::size_t begin, const std::size_t end, Visible visible)
+    {
+        std::size_t count = 0;
+        for(std::size_t i = begin; i < end; ++i) { count += visible(i); }
+        return count;
+    }
+
+    /// Branch free compaction - index is always written, output position advances only for visible shapes.
+    /// Stops after the last visible one, so it never writes into output of the next chunk.
+    template<typename Visible>
+    static void scatter_visible(const std::size_t begin, const std::size_t end, std::uint32_t* out,
+                                const std::size_t count, Visible visible)
+    {
+        std::size_t written = 0;
+        for(std::size_t i = begin; i < end && written < count; ++i)
+        {
+            out[written] = static_cast<std::uint32_t>(i);
+            written += visible(i);
+        }
+    }
+
+    static DrawCommand project(const float x, const float y, const float z, const float size)
+    {
+        const float scale = focal_length / (focal_length + z);
+        return DrawCommand{x * scale, y * scale, size * scale};
+    }
+
+public:
+    explicit FramePipeline(thread_pool& pool_, const unsigned threads = 0) :
+        pool(pool_),
+        chunks(threads != 0 ? threads : pool_.size() + 1),
+        buffers(chunks)
+    {}
+
+    unsigned thread_count() const { return this->chunks; }
+
+    /// Culling: count visible per chunk, exclusive scan of counts gives each chunk its output offset, then every
+    /// chunk scatters its indices. Draw: every chunk projects its part of the lists into its own buffer and buffers
+    /// are concatenated in chunk order, so the output doesnt depend on thread count.
+    void update(const ShapesGeometry& geometry, const ViewBox& view, FrameOutput& frame)
+    {
+        const CircleColumns& circles = geometry.circles;
+        const SquareColumns& squares = geometry.squares;
+        const auto circle_visible_at = [&](const std::size_t i){ return circle_visible(view, circles, i); };
+        const auto square_visible_at = [&](const std::size_t i){ return square_visible(view, squares, i); };
+
+        this->for_each_chunk([&](const unsigned chunk){
+            chunk_buffers& buffer = *this->buffers[chunk];
+            const auto c = chunk_range(circles.size(), chunk, this->chunks);
+            const auto s = chunk_range(squares.size(), chunk, this->chunks);
+            buffer.circles_visible = count_visible(c.first, c.second, circle_visible_at);
+            buffer.squares_visible = count_visible(s.first, s.second, square_visible_at);
+        });
+
+        std::vector<std::size_t> circle_offsets(this->chunks + 1, 0), square_offsets(this->chunks + 1, 0);
+        for(unsigned chunk = 0; chunk < this->chunks; ++chunk)
+        {
+            circle_offsets[chunk + 1] = circle_offsets[chunk] + this->buffers[chunk]->circles_visible;
+            square_offsets[chunk + 1] = square_offsets[chunk] + this->buffers[chunk]->squares_visible;
+        }
+        frame.visible_circles.resize(circle_offsets.back());
+        frame.visible_squares.resize(square_offsets.back());
+
+        this->for_each_chunk([&](const unsigned chunk){
+            const auto c = chunk_range(circles.size(), chunk, this->chunks);
+            const auto s = chunk_range(squares.size(), chunk, this->chunks);
+            chunk_buffers& buffer = *this->buffers[chunk];
+            scatter_visible(c.first, c.second, frame.visible_circles.data() + circle_offsets[chunk],
+                            buffer.circles_visible, circle_visible_at);
+            scatter_visible(s.first, s.second, frame.visible_squares.data() + square_offsets[chunk],
+                            buffer.squares_visible, square_visible_at);
+        });
+
+        this->for_each_chunk([&](const unsigned chunk){
+            chunk_buffers& buffer = *this->buffers[chunk];
+            buffer.circle_commands.clear();
+            buffer.square_commands.clear();
+            const auto c = chunk_range(frame.visible_circles.size(), chunk, this->chunks);
+            for(std::size_t n = c.first; n < c.second; ++n)
+            {
+                const std::uint32_t i = frame.visible_circles[n];
+                buffer.circle_commands.push_back(project(circles.x[i], circles.y[i], circles.z[i], circles.radius[i]));
+            }
+            const auto s = chunk_range(frame.visible_squares.size(), chunk, this->chunks);
+            for(std::size_t n = s.first; n < s.second; ++n)
+            {
+                const std::uint32_t i = frame.visible_squares[n];
+                buffer.square_commands.push_back(project(squares.x[i], squares.y[i], squares.z[i], squares.side[i]));
+            }
+        });
+
+        frame.circle_commands.clear();
+        frame.square_commands.clear();
+        for(const padded<chunk_buffers>& buffer : this->buffers)
+        {
+            frame.circle_commands.insert(frame.circle_commands.end(), buffer->circle_commands.begin(), buffer->circle_commands.end());
+            frame.square_commands.insert(frame.square_commands.end(), buffer->square_commands.begin(), buffer->square_commands.end());
+        }
+    }
+};
+
+/// Deterministic scene, circles and squares interleaved
+ShapesGeometry make_scene(const uint size, std::vector<ShapeHandle>* handles = nullptr)
 {
-    using shape = std::pair<ShapeID, common::Color>;
     ShapesGeometry shapes(size);
-    ShapeRender render(size);
     for(uint i = 0; i < size; ++i)
     {
-        if(i % 2 == 0)
+        const common::Point3D position = common::position_of(i);
+        const float extent = common::extent_of(i);
+        const ShapeHandle handle = i % 2 == 0 ? shapes.add_circle(CircleGeometry{position, extent})
+                                              : shapes.add_square(SquareGeometry{position, extent});
+        if(handles) { handles->push_back(handle); }
+    }
+    return shapes;
+}
+
+void benchmark_fn(bench::harness& harness, const uint size)
+{
+    std::vector<ShapeHandle> handles;
+    ShapesGeometry shapes = make_scene(size, &handles);
+    ShapeRender render(size);
+    for(const ShapeHandle& handle : handles)
+    {
+        const common::Color color{0, 0, 0};
+        render.visible.emplace_back(handle, color);
+    }
+
+    /// Measure time for each call
+    harness.run("cache_friendly draw", [&]{ draw(render, shapes); }, size);
+    float Result = 0.f;
+    harness.run("cache_friendly area", [&]{ Result = area(shapes); }, size);
+    std::cout << "[cache_friendly] total area=" << Result << std::endl;
+}
+
+/// Store operations and kernels on a big scene: area and bounding box over columns versus array of structures
+void shape_store_test(bench::harness& harness, const uint size)
+{
+    std::vector<ShapeHandle> handles;
+    ShapesGeometry shapes = make_scene(size, &handles);
+
+    /// every third shape dies, its handle must go stale and others must still resolve to their own shape
+    for(std::size_t i = 0; i < handles.size(); i += 3) { shapes.remove(handles[i]); }
+    std::size_t alive = 0;
+    for(std::size_t i = 0; i < handles.size(); ++i)
+    {
+        if(not shapes.alive(handles[i])) { continue; }
+        ++alive;
+        const ShapeID id = shapes.locate(handles[i]);
+        const float x = id.kind == ShapeKind::Circle ? shapes.circle(id.index).center.x
+                                                     : shapes.square(id.index).top_left_pnt.x;
+        if(x != float(i % 1000)) { std::cout << "[shape_store] handle " << i << " resolved to wrong shape" << std::endl; }
+    }
+    const ShapeHandle reused = shapes.add_circle(CircleGeometry{{0.f, 0.f, 0.f}, 1.f});
+    std::cout << "[shape_store] size=" << shapes.size() << " alive handles=" << alive
+              << " stale handle reused=" << std::boolalpha << shapes.alive(handles[0]) << " new handle alive="
+              << shapes.alive(reused) << std::endl;
+    shapes.remove(reused);
+
+    /// extents which are not exact in binary, their squares differ between float and double arithmetic
+    for(uint i = 0; i < size / 10; ++i)
+    {
+        const float extent = 0.1f * float(1 + i % 9);
+        shapes.add_circle(CircleGeometry{common::position_of(i), extent});
+        shapes.add_square(SquareGeometry{common::position_of(i), extent});
+    }
+
+    std::vector<CircleGeometry> circles;
+    std::vector<SquareGeometry> squares;
+    for(std::size_t i = 0; i < shapes.circles.size(); ++i) { circles.push_back(shapes.circle(i)); }
+    for(std::size_t i = 0; i < shapes.squares.size(); ++i) { squares.push_back(shapes.square(i)); }
+
+    double soa_area = 0., aos_area = 0.;
+    BoundingBox box{};
+    harness.run("shape_store columns area", [&]{ soa_area = area_kernel(shapes); }, shapes.size());
+    harness.run("shape_store columns bbox", [&]{ box = bounding_box(shapes); }, shapes.size());
+    harness.run("shape_store structs area", [&]{
+        aos_area = 0.;
+        for(const CircleGeometry& c : circles) { aos_area += std::numbers::pi * double(c.radius) * c.radius; }
+        for(const SquareGeometry& s : squares) { aos_area += double(s.side) * s.side; }
+    }, shapes.size());
+    /// columns and structs sum the same terms, only in different order
+    std::cout << "[shape_store] area columns=" << soa_area << " structs=" << aos_area
+              << " same=" << (std::abs(soa_area - aos_area) <= 5e-11 * aos_area)
+              << " bbox=(" << box.min.x << "," << box.min.y << "," << box.min.z << ")-("
+              << box.max.x << "," << box.max.y << "," << box.max.z << ")" << std::endl;
+}
+
+/// Same frames with one thread and with whole pool, outputs must be identical
+void frame_update_test(bench::harness& harness, const uint size)
+{
+    const ShapesGeometry shapes = make_scene(size);
+    const ViewBox view{{100.f, 100.f, 0.f}, {700.f, 600.f, 5.f}};
+    thread_pool& pool = default_thread_pool();
+
+    FrameOutput serial_frame, parallel_frame;
+    FramePipeline serial(pool, 1);
+    FramePipeline parallel(pool);
+    harness.run("frame_update threads=1", [&]{ serial.update(shapes, view, serial_frame); }, size);
+    harness.run("frame_update threads=" + std::to_string(parallel.thread_count()),
+                [&]{ parallel.update(shapes, view, parallel_frame); }, size);
+    const auto same = [](const std::vector<DrawCommand>& a, const std::vector<DrawCommand>& b) {
+        return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const DrawCommand& l, const DrawCommand& r) {
+            return l.x == r.x && l.y == r.y && l.size == r.size;
+        });
+    };
+    std::cout << "[frame_update] visible circles=" << parallel_frame.visible_circles.size()
+              << " squares=" << parallel_frame.visible_squares.size() << " of " << shapes.size()
+              << " same as serial=" << std::boolalpha
+              << (serial_frame.visible_circles == parallel_frame.visible_circles &&
+                  serial_frame.visible_squares == parallel_frame.visible_squares &&
+                  same(serial_frame.circle_commands, parallel_frame.circle_commands) &&
+                  same(serial_frame.square_commands, parallel_frame.square_commands)) << std::endl;
+}
+} ///< namespace cache_friendly
+
+/**
+ *  False sharing: threads write only their own variables, but when the variables share a cache line every write
+ *  takes the line away from the other cores. Same work runs on adjacent and on padded (own cache line) slots.
+ *  On one core threads dont run at the same time, so both layouts cost the same there.
+ */
+namespace false_sharing
+{
+/// Per worker statistics - written only by its worker, read by anyone (relaxed atomics, no read-modify-write)
+struct worker_stats
+{
+    std::atomic<std::uint64_t> tasks{0};
+    std::atomic<std::uint64_t> bytes{0};
+    std::atomic<std::uint64_t> max_latency{0};
+
+    void record(const std::uint64_t task_bytes, const std::uint64_t latency)
+    {
+        this->tasks.store(this->tasks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        this->bytes.store(this->bytes.load(std::memory_order_relaxed) + task_bytes, std::memory_order_relaxed);
+        if(latency > this->max_latency.load(std::memory_order_relaxed))
         {
-            CircleGeometry circle;
-            shapes.circles.push_back(std::move(circle));
-
-            ShapeID circle_id;
-            circle_id.index = i;
-            circle_id.kind = ShapeKind::Circle;
-            common::Color color;
-            render.visible.emplace_back(circle_id, color);
+            this->max_latency.store(latency, std::memory_order_relaxed);
         }
-        else
+    }
+};
+
+template<typename T>
+T& slot(T& value) { return value; }
+template<typename T>
+T& slot(padded<T>& value) { return value.value; }
+
+/// Threads started and pinned up front, waiting until go() releases them all at once. Thread t runs on t-th cpu
+/// the process may use, so adjacent and padded variants compare threads on distinct cores.
+class starting_line
+{
+private:
+    std::atomic<unsigned> ready;
+    std::atomic<unsigned> pin_failures;
+    std::atomic<bool> released;
+    std::vector<std::thread> workers;
+
+public:
+    template<typename Work>
+    starting_line(const std::vector<unsigned>& cpus, const unsigned threads, Work work) :
+        ready(0),
+        pin_failures(0),
+        released(false)
+    {
+        for(unsigned t = 0; t < threads; ++t)
         {
-            SquareGeometry square;
-            shapes.squares.push_back(std::move(square));
-
-            ShapeID circle_id;
-            circle_id.index = i;
-            circle_id.kind = ShapeKind::Square;
-            common::Color color;
-            render.visible.emplace_back(circle_id, color);
+            const unsigned cpu = cpus[t % cpus.size()];
+            this->workers.emplace_back([this, work, t, cpu]{
+                if(not bench::pin_current_thread(cpu)) { this->pin_failures.fetch_add(1); }
+                this->ready.fetch_add(1);
+                while(not this->released.load(std::memory_order_acquire)) { std::this_thread::yield(); }
+                work(t);
+            });
         }
+        while(this->ready.load() != threads) { std::this_thread::yield(); }
     }
+    starting_line(const starting_line&) = delete;
+    starting_line& operator=(const starting_line&) = delete;
+    ~starting_line() { this->go(); }
 
-    /// Measure time for each call
-    draw(render, shapes);
-    const float Result = area(shapes);
+    /// Threads which could not be pinned, final once the constructor returns
+    unsigned failed_pins() const { return this->pin_failures.load(); }
+
+    /// Releases the threads and waits for all of them
+    void go()
+    {
+        this->released.store(true, std::memory_order_release);
+        for(std::thread& worker : this->workers)
+        {
+            if(worker.joinable()) { worker.join(); }
+        }
+    }
+};
+
+/// Containers and threads are prepared in the unmeasured setup, sample is time from go to the last join
+template<typename Container, typename Work, typename Count>
+void together_test(bench::harness& harness, const std::string& name, const unsigned threads,
+                   const std::uint64_t iterations, Work work, Count count)
+{
+    const std::vector<unsigned> cpus = bench::allowed_cpus();
+    std::unique_ptr<Container> container;
+    std::unique_ptr<starting_line> line;
+    unsigned failed_pins = 0;
+    const bench::statistics& result = harness.run_with_setup(name + " threads=" + std::to_string(threads), [&]{
+        line.reset();
+        container = std::make_unique<Container>(threads);
+        line = std::make_unique<starting_line>(cpus, threads, [&container, &work, iterations](const unsigned t){
+            work(*container, t, iterations);
+        });
+        failed_pins = std::max(failed_pins, line->failed_pins());
+    }, [&]{ line->go(); }, threads * iterations);
+    line.reset();
+    if(failed_pins != 0)
+    {
+        std::cerr << "[false_sharing] pinning failed for " << failed_pins << " of " << threads << " threads" << std::endl;
+    }
+
+    std::cout << "[false_sharing] " << name << " threads=" << threads << " per thread="
+              << result.items_per_second / 1e6 / threads << "[Mops/s]"
+              << (count(*container) == threads * iterations ? "" : " WRONG COUNT") << std::endl;
 }
-} ///< namespace cache_friendly
 
-int main()
+/// Every thread bumps its own counter
+template<typename Counters>
+void counters_test(bench::harness& harness, const std::string& name, const unsigned threads,
+                   const std::uint64_t iterations)
+{
+    together_test<Counters>(harness, name, threads, iterations,
+        [](Counters& counters, const unsigned t, const std::uint64_t n){
+            std::atomic<std::uint64_t>& counter = slot(counters[t]);
+            for(std::uint64_t i = 0; i < n; ++i) { counter.fetch_add(1, std::memory_order_relaxed); }
+        },
+        [](Counters& counters){
+            std::uint64_t total = 0;
+            for(auto& counter : counters) { total += slot(counter).load(); }
+            return total;
+        });
+}
+
+/// Every thread updates its own statistics struct
+template<typename Stats>
+void stats_test(bench::harness& harness, const std::string& name, const unsigned threads,
+                const std::uint64_t iterations)
+{
+    together_test<Stats>(harness, name, threads, iterations,
+        [](Stats& stats, const unsigned t, const std::uint64_t n){
+            worker_stats& own = slot(stats[t]);
+            for(std::uint64_t i = 0; i < n; ++i) { own.record(i & 63, i & 1023); }
+        },
+        [](Stats& stats){
+            std::uint64_t total = 0;
+            for(auto& s : stats) { total += slot(s).tasks.load(); }
+            return total;
+        });
+}
+
+/// Throughput per thread count: 1, 2, 4 ... up to hardware threads (at least 4)
+void benchmark_fn(bench::harness& harness, const std::uint64_t iterations)
+{
+    const unsigned max_threads = std::max(4u, std::thread::hardware_concurrency());
+    const std::size_t allowed = bench::allowed_cpus().size();
+    for(unsigned threads = 1; threads <= max_threads; threads *= 2)
+    {
+        if(threads > allowed)
+        {
+            std::cerr << "[false_sharing] " << threads << " threads share " << allowed << " allowed cpus" << std::endl;
+        }
+        counters_test<std::vector<std::atomic<std::uint64_t>>>(harness, "adjacent counters", threads, iterations);
+        counters_test<cache_aligned_vector<padded<std::atomic<std::uint64_t>>>>(harness, "padded counters", threads,
+                                                                                 iterations);
+        stats_test<std::vector<worker_stats>>(harness, "adjacent worker_stats", threads, iterations);
+        stats_test<cache_aligned_vector<padded<worker_stats>>>(harness, "padded worker_stats", threads, iterations);
+    }
+}
+} ///< namespace false_sharing
+
+int main(int argc, char** argv)
 {
-    cache_non_friendly::benchmark_fn(1000);
-    cache_friendly::benchmark_fn(1000);
+    bench::harness harness("false_sharing", argc, argv);
+    cache_non_friendly::benchmark_fn(harness, 1000);
+    cache_non_friendly::poly_collection_test(harness, 2'000'000);
+    cache_friendly::benchmark_fn(harness, 1000);
+    cache_friendly::shape_store_test(harness, 2'000'000);
+    cache_friendly::frame_update_test(harness, 2'000'000);
+    false_sharing::benchmark_fn(harness, 10'000'000);
     return 0;
 }
\ No newline at end of file
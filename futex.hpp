@@ -0,0 +1,50 @@
+#pragma once
+/**
+ *  Minimal futex wrapper - lets a thread sleep until an atomic int changes, without mutex and condition variable.
+ *  On systems without futex the wait degrades to yield, so callers must re-check their condition in a loop anyway.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <thread>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/// Sleeps while word == expected. May return spuriously.
+inline void futex_wait(std::atomic<int>& word, const int expected)
+{
+#if defined(__linux__)
+    static_assert(sizeof(std::atomic<int>) == sizeof(int), "futex needs plain int layout");
+    syscall(SYS_futex, reinterpret_cast<int*>(&word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+#else
+    if(word.load() == expected) { std::this_thread::yield(); }
+#endif
+}
+
+/// Sleeps while word == expected, at most timeout. May return spuriously.
+inline void futex_wait_for(std::atomic<int>& word, const int expected, const std::chrono::nanoseconds timeout)
+{
+#if defined(__linux__)
+    const timespec relative{static_cast<time_t>(timeout.count() / 1000000000),
+                            static_cast<long>(timeout.count() % 1000000000)};
+    syscall(SYS_futex, reinterpret_cast<int*>(&word), FUTEX_WAIT_PRIVATE, expected, &relative, nullptr, 0);
+#else
+    if(word.load() == expected) { std::this_thread::sleep_for(timeout); }
+#endif
+}
+
+/// Wakes up to count threads sleeping in futex_wait on word
+inline void futex_wake(std::atomic<int>& word, const int count)
+{
+#if defined(__linux__)
+    syscall(SYS_futex, reinterpret_cast<int*>(&word), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+#else
+    static_cast<void>(word);
+    static_cast<void>(count);
+#endif
+}
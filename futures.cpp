@@ -1,52 +1,218 @@
-#include <deque>
-#include <mutex>
+#include <atomic>
+#include <chrono>
 #include <future>
+#include <memory>
+#include <type_traits>
+#include <vector>
 #include <thread>
 #include <utility>
 #include <iostream>
 #include <functional>
 
+#include "thread_pool.hpp"
+#include "cache_line.hpp"
+#include "futex.hpp"
+#include "unique_task.hpp"
+
 int calculate() { return 42*42; }
 void do_other_stuff() {}
 int returning_value_async_foo()
 {
     std::future<int> the_answer=std::async(calculate);
     do_other_stuff();
-    std::cout<<"The answer is " << the_answer.get() << std::endl;
+    const int answer = the_answer.get();
+    std::cout<<"The answer is " << answer << std::endl;
+    return answer;
 }
 
 
-std::mutex m;
-std::deque<std::packaged_task<void()>> tasks;
+/// Intrusive multi-producer single-consumer queue (Vyukov). Node carries the task and comes from block_pool.
+/// push is a single exchange and never waits for other producers. pop may return nullptr while producer is between
+/// its two steps - consumer just sees the task on the next pass.
+class mpsc_task_queue
+{
+public:
+    struct node
+    {
+        std::atomic<node*> next{nullptr};
+        unique_task task;
+        node() = default;
+        explicit node(unique_task&& task_) : task(std::move(task_)) {}
+    };
 
-bool gui_shutdown_message_received() { return false; }
-void get_and_process_user_input();
+private:
+    padded<std::atomic<node*>> head; ///< producers push here
+    node* tail;                       ///< consumer pops here
+    node stub;
 
-void gui_thread()
+public:
+    mpsc_task_queue() : head(&stub), tail(&stub) {}
+    mpsc_task_queue(const mpsc_task_queue&) = delete;
+    mpsc_task_queue& operator=(const mpsc_task_queue&) = delete;
+    ~mpsc_task_queue()
+    {
+        while(node* const n = pop()) { pool_delete(n); }
+    }
+
+    /// any thread
+    void push(node* n)
+    {
+        n->next.store(nullptr, std::memory_order_relaxed);
+        node* const prev = head->exchange(n);
+        prev->next.store(n, std::memory_order_release);
+    }
+
+    /// consumer only
+    node* pop()
+    {
+        node* t = this->tail;
+        node* next = t->next.load(std::memory_order_acquire);
+        if(t == &stub)
+        {
+            if(not next) { return nullptr; }
+            this->tail = next;
+            t = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if(next)
+        {
+            this->tail = next;
+            return t;
+        }
+        if(t != head->load()) { return nullptr; } ///< producer didnt link its node yet
+        push(&stub);
+        next = t->next.load(std::memory_order_acquire);
+        if(next)
+        {
+            this->tail = next;
+            return t;
+        }
+        return nullptr;
+    }
+
+    /// consumer only
+    bool empty() const
+    {
+        return this->tail == &stub && head->load() == &stub;
+    }
+};
+
+/// Event loop owning one thread's task queue. Other threads post tasks, loop thread runs them in batches and sleeps
+/// on futex while there is nothing to do.
+class gui_event_loop
 {
-    while(!gui_shutdown_message_received())
+private:
+    enum : int { running = 0, sleeping = 1 };
+
+    mpsc_task_queue queue;
+    std::atomic<int> loop_state;
+    std::atomic<bool> stop_requested;
+
+    /// Producer side: store to queue and load of loop_state are both seq_cst, same as store of loop_state and
+    /// load of queue head in wait_for_work(). Either loop sees the task or producer sees the loop sleeping.
+    void wake()
+    {
+        if(this->loop_state.exchange(running) == sleeping) { futex_wake(this->loop_state, 1); }
+    }
+
+    void wait_for_work()
+    {
+        this->loop_state.store(sleeping);
+        if(this->queue.empty() && not this->stop_requested.load()) { futex_wait(this->loop_state, sleeping); }
+        this->loop_state.store(running);
+    }
+
+public:
+    gui_event_loop() : loop_state(running), stop_requested(false) {}
+
+    /// Runs every queued task, returns number of tasks run. Loop thread only.
+    std::size_t drain()
     {
-        get_and_process_user_input();
-        std::packaged_task<void()> task;
+        std::size_t count = 0;
+        while(mpsc_task_queue::node* const task = this->queue.pop())
         {
-            std::lock_guard<std::mutex> lk(m);
-            if(tasks.empty()) { continue; }
-            task=std::move(tasks.front());
-            tasks.pop_front();
+            unique_task run(std::move(task->task));
+            pool_delete(task);
+            run(); ///< when this finishes, future associated with that task will be ready
+            ++count;
         }
-        task(); ///< when this finishes, future associated with that task will be ready
+        return count;
     }
+
+    /// Body of the loop thread. Returns after stop() once queue is empty.
+    template<typename Idle>
+    void run(Idle on_wakeup)
+    {
+        while(true)
+        {
+            on_wakeup();
+            drain();
+            if(this->stop_requested.load() && this->queue.empty()) { return; }
+            wait_for_work();
+        }
+    }
+
+    /// Allocation free for callables up to 48 bytes: node and future state come from block_pool
+    template<typename Func>
+    task_future<std::invoke_result_t<Func>> post(Func f)
+    {
+        packaged<std::invoke_result_t<Func>> task = package_task(std::move(f));
+        this->queue.push(pool_new<mpsc_task_queue::node>(std::move(task.task)));
+        wake();
+        return std::move(task.future);
+    }
+
+    void stop()
+    {
+        this->stop_requested.store(true);
+        wake();
+    }
+};
+
+gui_event_loop gui_loop;
+
+void get_and_process_user_input() {}
+
+void gui_thread()
+{
+    gui_loop.run(get_and_process_user_input);
 }
 
 template<typename Func>
-std::future<void> post_task_for_gui_thread(Func f)
+task_future<void> post_task_for_gui_thread(Func f)
+{
+    return gui_loop.post([f = std::move(f)]() mutable { f(); });
+}
+
+/// Cost of wrapping, running and reading result of one small task
+void task_wrapper_overhead_test(const int tasks)
 {
-    std::packaged_task<void()> task(f);
-    std::future<void> res=task.get_future();    ///< Here we get a future from a task
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    long sum = 0;
+    for(int i = 0; i < tasks; ++i)
+    {
+        std::packaged_task<int()> task([i](){ return i; });
+        std::future<int> res = task.get_future();
+        std::function<void()> queued([t = std::make_shared<std::packaged_task<int()>>(std::move(task))](){ (*t)(); });
+        queued();
+        sum += res.get();
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    std::cout << "[std::function + std::packaged_task] sum=" << sum << " time="
+              << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() << "[ms]" << std::endl;
 
-    std::lock_guard<std::mutex> lk(m);
-    tasks.push_back(std::move(task)); ///< Add task to list shared with gui thread.
-    return res;
+    begin = std::chrono::steady_clock::now();
+    sum = 0;
+    for(int i = 0; i < tasks; ++i)
+    {
+        packaged<int> task = package_task([i](){ return i; });
+        unique_task queued(std::move(task.task));
+        queued();
+        sum += task.future.get();
+    }
+    end = std::chrono::steady_clock::now();
+    std::cout << "[unique_task + task_future] sum=" << sum << " time="
+              << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() << "[ms]" << std::endl;
 }
 
 int main()
@@ -54,11 +220,45 @@ int main()
     std::thread gui_bg_thread(gui_thread);
     
     std::function<void()> f_1( [](){std::cout << "task 1" << std::endl;} );
-    std::future<void> f_1_result = post_task_for_gui_thread(f_1);
+    task_future<void> f_1_result = post_task_for_gui_thread(f_1);
     
     auto f_2 = [](int a, int b){std::cout << "task 2" << std::endl;};
-    std::future<void> f_2_result = post_task_for_gui_thread(std::bind(f_2, 1,2));   ///< C++14 feature - automatic template type deduction
+    task_future<void> f_2_result = post_task_for_gui_thread(std::bind(f_2, 1,2));   ///< C++14 feature - automatic template type deduction
+
+    /// heavy work runs on the pool, only the GUI update continues on the gui thread
+    task_future<void> f_3_result = default_thread_pool().submit_task(calculate).then(gui_loop, [](task_future<int> value){
+        std::cout << "task 3: " << value.get() << std::endl;
+    });
+
+    /// first of several answers wins, nobody waits for the slower ones
+    std::vector<task_future<int>> answers;
+    answers.push_back(default_thread_pool().submit_task([](){ return 1; }));
+    answers.push_back(default_thread_pool().submit_task([](){ std::this_thread::sleep_for(std::chrono::milliseconds(50)); return 2; }));
+    task_future<void> f_4_result = when_any(std::move(answers)).then(gui_loop, [](task_future<when_any_result<int>> any){
+        when_any_result<int> first = any.get();
+        std::cout << "task 4: answer " << first.index << " came first: " << first.futures[first.index].get() << std::endl;
+    });
 
     f_1_result.get();
     f_2_result.get();
+    f_3_result.get();
+    f_4_result.get();
+
+    /// many producers, loop thread drains whatever piled up in one pass
+    std::atomic<int> counter(0);
+    std::vector<std::thread> producers;
+    for(int p = 0; p < 4; ++p)
+    {
+        producers.emplace_back([&counter](){
+            for(int i = 0; i < 10000; ++i) { post_task_for_gui_thread([&counter](){ ++counter; }); }
+        });
+    }
+    for(std::thread& t : producers) { t.join(); }
+    gui_loop.post([&counter](){ return counter.load(); }).wait();
+    std::cout << "tasks run: " << counter.load() << std::endl;
+
+    gui_loop.stop();
+    gui_bg_thread.join();
+
+    task_wrapper_overhead_test(1000000);
 }
\ No newline at end of file
@@ -0,0 +1,169 @@
+#pragma once
+/**
+ *  Hazard pointers - safe memory reclamation for lock-free containers.
+ *
+ *  Before dereferencing a node that another thread may delete, a thread publishes the node address in one of its
+ *  hazard pointers. Removed nodes are not deleted right away but retired to a thread local list. Once the list grows
+ *  big enough it is scanned and only nodes that are not referenced by any hazard pointer are deleted.
+ */
+
+#include <atomic>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <stdexcept>
+
+#include "cache_line.hpp"
+
+namespace hazard
+{
+constexpr unsigned max_hazard_pointers = 128;           ///< hazard pointer records shared by all threads
+constexpr unsigned max_hazard_pointers_per_thread = 2;  ///< eg. Michael-Scott queue protects head and head->next
+constexpr unsigned retire_threshold = 2 * max_hazard_pointers;
+
+/// One record per hazard pointer. Aligned to cache line, so threads dont invalidate each others records.
+struct alignas(cache_line_size) hazard_record
+{
+    std::atomic<bool> active{false};
+    std::atomic<void*> pointer{nullptr};
+};
+
+inline hazard_record hazard_records[max_hazard_pointers];
+
+/// Node removed from container, waiting for deletion
+struct retired_node
+{
+    void* pointer;
+    void (*deleter)(void*);
+};
+
+/// Returns true if any thread currently marks pointer as hazardous
+inline bool outstanding_hazard_pointers_for(const void* pointer)
+{
+    for(hazard_record& record : hazard_records)
+    {
+        if(record.pointer.load() == pointer) { return true; }
+    }
+    return false;
+}
+
+/// Deletes nodes which are not referenced by any hazard pointer. Referenced ones stay in the list.
+inline void reclaim(std::vector<retired_node>& retired)
+{
+    std::vector<void*> hazards;
+    hazards.reserve(max_hazard_pointers);
+    for(hazard_record& record : hazard_records)
+    {
+        if(void* const pointer = record.pointer.load()) { hazards.push_back(pointer); }
+    }
+    std::sort(hazards.begin(), hazards.end());
+
+    const auto still_hazardous = [&hazards](const retired_node& node){
+        return std::binary_search(hazards.begin(), hazards.end(), node.pointer);
+    };
+    const auto first_free = std::partition(retired.begin(), retired.end(), still_hazardous);
+    std::for_each(first_free, retired.end(), [](const retired_node& node){ node.deleter(node.pointer); });
+    retired.erase(first_free, retired.end());
+}
+
+/// Nodes left behind by finished threads. Touched only when thread exits, so mutex is fine here.
+class orphans
+{
+private:
+    std::mutex m;
+    std::vector<retired_node> nodes;
+public:
+    void adopt(std::vector<retired_node>& retired)
+    {
+        std::lock_guard<std::mutex> lock(m);
+        nodes.insert(nodes.end(), retired.begin(), retired.end());
+        reclaim(nodes);
+    }
+    ~orphans()
+    {
+        reclaim(nodes);
+    }
+};
+
+inline orphans orphaned_nodes;
+
+/// Thread local list of retired nodes. Scanned when it grows above retire_threshold.
+class retired_list
+{
+private:
+    std::vector<retired_node> nodes;
+public:
+    retired_list() { nodes.reserve(retire_threshold); }
+    ~retired_list()
+    {
+        reclaim(nodes);
+        if(not nodes.empty()) { orphaned_nodes.adopt(nodes); }
+    }
+
+    void add(retired_node node)
+    {
+        nodes.push_back(node);
+        if(nodes.size() >= retire_threshold) { reclaim(nodes); }
+    }
+};
+
+/// Owns a hazard record for the lifetime of a thread
+class hazard_pointer_owner
+{
+private:
+    hazard_record* record;
+public:
+    hazard_pointer_owner() : record(nullptr)
+    {
+        for(hazard_record& candidate : hazard_records)
+        {
+            bool expected = false;
+            if(candidate.active.compare_exchange_strong(expected, true))
+            {
+                this->record = &candidate;
+                return;
+            }
+        }
+        throw std::runtime_error("No hazard pointers available");
+    }
+    hazard_pointer_owner(const hazard_pointer_owner&) = delete;
+    hazard_pointer_owner& operator=(const hazard_pointer_owner&) = delete;
+    ~hazard_pointer_owner()
+    {
+        this->record->pointer.store(nullptr);
+        this->record->active.store(false);
+    }
+
+    std::atomic<void*>& get_pointer() { return this->record->pointer; }
+};
+
+/// Returns hazard pointer number slot of current thread
+inline std::atomic<void*>& get_hazard_pointer_for_current_thread(const unsigned slot = 0)
+{
+    thread_local static hazard_pointer_owner owners[max_hazard_pointers_per_thread];
+    return owners[slot].get_pointer();
+}
+
+/// Loads src and publishes it in hazard pointer. Returned node is safe to dereference until hazard pointer is cleared.
+template<typename T>
+T* protect(std::atomic<void*>& hazard_pointer, const std::atomic<T*>& src)
+{
+    T* pointer = src.load();
+    T* published;
+    do
+    {
+        published = pointer;
+        hazard_pointer.store(published);
+        pointer = src.load();
+    } while(pointer != published);
+    return pointer;
+}
+
+/// Schedules node for deletion once no hazard pointer references it
+template<typename T>
+void retire(T* pointer)
+{
+    thread_local static retired_list retired;
+    retired.add(retired_node{pointer, [](void* p){ delete static_cast<T*>(p); }});
+}
+} ///< namespace hazard
@@ -0,0 +1,297 @@
+#pragma once
+/**
+ *  Lock hierarchy - every mutex gets a level and thread may lock a mutex only when its level is lower than the level
+ *  of every mutex the thread already holds. If all threads follow one order, two of them can never wait for each
+ *  other in a cycle, so there is no deadlock.
+ *
+ *  HIERARCHICAL_MUTEX_MODE selects how much is checked:
+ *  - 0 release: no checks, basic_hierarchical_mutex<M> is just M (level is ignored, no extra members).
+ *  - 1 checked: hierarchy violation throws std::logic_error. Costs a thread local vector push/pop per lock.
+ *  - 2 debug:   violations are reported to stderr instead of thrown. Additionally every "held A while locking B"
+ *               edge is recorded in process wide lock graph and an edge which closes a cycle (possible deadlock,
+ *               even if it never happened) is reported with the locks held by the thread and its backtrace.
+ *               Each thread caches edges it already recorded, so the global graph is locked only for new edges.
+ *  Default is 2 without NDEBUG and 0 with NDEBUG. Staging builds can pass -DHIERARCHICAL_MUTEX_MODE=2 explicitly.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#if defined(__GLIBC__)
+#include <execinfo.h>
+#include <unistd.h>
+#endif
+
+#ifndef HIERARCHICAL_MUTEX_MODE
+#ifdef NDEBUG
+#define HIERARCHICAL_MUTEX_MODE 0
+#else
+#define HIERARCHICAL_MUTEX_MODE 2
+#endif
+#endif
+
+namespace hierarchy_detail
+{
+struct held_lock
+{
+    const void* mutex;
+    unsigned long level;
+    const char* name;
+};
+
+/// Locks held by current thread in acquisition order
+inline std::vector<held_lock>& held_locks()
+{
+    thread_local static std::vector<held_lock> held;
+    return held;
+}
+
+inline unsigned long current_level()
+{
+    const std::vector<held_lock>& held = held_locks();
+    return held.empty() ? ULONG_MAX : held.back().level;
+}
+
+inline void print_held_locks_and_backtrace()
+{
+    std::fprintf(stderr, "  locks held by this thread (oldest first):\n");
+    for(const held_lock& lock : held_locks())
+    {
+        std::fprintf(stderr, "    %s (level %lu, %p)\n", lock.name, lock.level, lock.mutex);
+    }
+#if defined(__GLIBC__)
+    void* frames[32];
+    const int frame_count = backtrace(frames, 32);
+    std::fprintf(stderr, "  backtrace:\n");
+    backtrace_symbols_fd(frames, frame_count, STDERR_FILENO);
+#endif
+}
+
+/// Process wide graph of "A was held while B was locked" edges
+class lock_graph
+{
+private:
+    std::mutex m;
+    std::unordered_map<const void*, std::vector<const void*>> edges;
+    std::unordered_map<const void*, const char*> names;
+    std::atomic<std::uint64_t> generation{0}; ///< bumped when mutex is destroyed, its address may be reused
+
+    /// Path from 'from' to 'to' (both included), empty if there is none
+    std::vector<const void*> find_path(const void* from, const void* to)
+    {
+        std::vector<const void*> path;
+        std::unordered_set<const void*> visited;
+        const auto visit = [&](const auto& self, const void* node) -> bool {
+            path.push_back(node);
+            if(node == to) { return true; }
+            if(visited.insert(node).second)
+            {
+                const auto found = edges.find(node);
+                if(found != edges.end())
+                {
+                    for(const void* next : found->second) { if(self(self, next)) { return true; } }
+                }
+            }
+            path.pop_back();
+            return false;
+        };
+        visit(visit, from);
+        return path;
+    }
+
+public:
+    std::uint64_t current_generation() const { return generation.load(std::memory_order_acquire); }
+
+    void add_edge(const held_lock& held, const void* mutex, const char* name)
+    {
+        std::lock_guard<std::mutex> lk(m);
+        names[held.mutex] = held.name;
+        names[mutex] = name;
+        std::vector<const void*>& out = edges[held.mutex];
+        if(std::find(out.begin(), out.end(), mutex) != out.end()) { return; }
+
+        const std::vector<const void*> cycle = find_path(mutex, held.mutex);
+        out.push_back(mutex);
+        if(cycle.empty()) { return; }
+
+        std::fprintf(stderr, "hierarchical_mutex: lock order cycle (possible deadlock): ");
+        for(const void* node : cycle) { std::fprintf(stderr, "%s -> ", names[node]); }
+        std::fprintf(stderr, "%s\n", name);
+        print_held_locks_and_backtrace();
+    }
+
+    void remove(const void* mutex)
+    {
+        std::lock_guard<std::mutex> lk(m);
+        edges.erase(mutex);
+        for(auto& entry : edges)
+        {
+            std::vector<const void*>& out = entry.second;
+            out.erase(std::remove(out.begin(), out.end(), mutex), out.end());
+        }
+        names.erase(mutex);
+        generation.fetch_add(1, std::memory_order_release);
+    }
+};
+
+inline lock_graph& global_lock_graph()
+{
+    static lock_graph graph;
+    return graph;
+}
+
+/// Edges already in the global graph, so repeated lock patterns dont touch global mutex
+struct edge_cache
+{
+    std::uint64_t generation = 0;
+    std::unordered_set<std::string> known; ///< key is both addresses, kept as raw bytes
+};
+
+inline void record_edges(const void* mutex, const char* name)
+{
+    thread_local static edge_cache cache;
+    lock_graph& graph = global_lock_graph();
+    const std::uint64_t generation = graph.current_generation();
+    if(cache.generation != generation)
+    {
+        cache.known.clear();
+        cache.generation = generation;
+    }
+    for(const held_lock& held : held_locks())
+    {
+        const void* key_parts[2] = {held.mutex, mutex};
+        if(cache.known.emplace(reinterpret_cast<const char*>(key_parts), sizeof(key_parts)).second)
+        {
+            graph.add_edge(held, mutex, name);
+        }
+    }
+}
+
+/// Called before mutex is locked, so the report comes out even if the thread then deadlocks
+inline void check_before_lock(const void* mutex, const unsigned long level, const char* name)
+{
+    if(current_level() <= level)
+    {
+        if constexpr(HIERARCHICAL_MUTEX_MODE == 1)
+        {
+            throw std::logic_error(std::string("mutex hierarchy violated locking ") + name);
+        }
+        std::fprintf(stderr, "hierarchical_mutex: locking %s (level %lu) violates hierarchy, current level %lu\n",
+                     name, level, current_level());
+        print_held_locks_and_backtrace();
+    }
+    if constexpr(HIERARCHICAL_MUTEX_MODE >= 2) { record_edges(mutex, name); }
+}
+
+inline void on_locked(const void* mutex, const unsigned long level, const char* name)
+{
+    held_locks().push_back(held_lock{mutex, level, name});
+}
+
+/// Locks dont have to be released in reverse order
+inline void on_unlocked(const void* mutex)
+{
+    std::vector<held_lock>& held = held_locks();
+    const auto found = std::find_if(held.rbegin(), held.rend(), [mutex](const held_lock& l){ return l.mutex == mutex; });
+    if(found != held.rend()) { held.erase(std::next(found).base()); }
+}
+} ///< namespace hierarchy_detail
+
+#if HIERARCHICAL_MUTEX_MODE == 0
+
+/// Release build - plain Mutex
+template<typename Mutex = std::mutex>
+class basic_hierarchical_mutex
+{
+private:
+    Mutex internal_mutex;
+public:
+    explicit basic_hierarchical_mutex(unsigned long /*level*/, const char* /*name*/ = "") {}
+
+    void lock() { internal_mutex.lock(); }
+    void unlock() { internal_mutex.unlock(); }
+    bool try_lock() { return internal_mutex.try_lock(); }
+
+    /// available only when Mutex is shared mutex
+    void lock_shared() { internal_mutex.lock_shared(); }
+    void unlock_shared() { internal_mutex.unlock_shared(); }
+    bool try_lock_shared() { return internal_mutex.try_lock_shared(); }
+};
+
+#else
+
+template<typename Mutex = std::mutex>
+class basic_hierarchical_mutex
+{
+private:
+    Mutex internal_mutex;
+    const unsigned long hierarchy_value;
+    const char* const name;
+
+    void check() const { hierarchy_detail::check_before_lock(this, hierarchy_value, name); }
+    void locked() const { hierarchy_detail::on_locked(this, hierarchy_value, name); }
+
+public:
+    explicit basic_hierarchical_mutex(const unsigned long level, const char* name_ = "hierarchical_mutex") :
+        hierarchy_value(level),
+        name(name_)
+    {}
+    basic_hierarchical_mutex(const basic_hierarchical_mutex&) = delete;
+    basic_hierarchical_mutex& operator=(const basic_hierarchical_mutex&) = delete;
+    ~basic_hierarchical_mutex()
+    {
+        if constexpr(HIERARCHICAL_MUTEX_MODE >= 2) { hierarchy_detail::global_lock_graph().remove(this); }
+    }
+
+    void lock()
+    {
+        check();
+        internal_mutex.lock();
+        locked();
+    }
+    void unlock()
+    {
+        hierarchy_detail::on_unlocked(this);
+        internal_mutex.unlock();
+    }
+    bool try_lock()
+    {
+        check();
+        if(not internal_mutex.try_lock()) { return false; }
+        locked();
+        return true;
+    }
+
+    /// available only when Mutex is shared mutex, shared and exclusive locks follow the same hierarchy
+    void lock_shared()
+    {
+        check();
+        internal_mutex.lock_shared();
+        locked();
+    }
+    void unlock_shared()
+    {
+        hierarchy_detail::on_unlocked(this);
+        internal_mutex.unlock_shared();
+    }
+    bool try_lock_shared()
+    {
+        check();
+        if(not internal_mutex.try_lock_shared()) { return false; }
+        locked();
+        return true;
+    }
+};
+
+#endif
+
+using hierarchical_mutex = basic_hierarchical_mutex<std::mutex>;
@@ -1,15 +1,37 @@
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
 #include <iostream>
 #include <mutex>
 #include <memory>
+#include <string>
 #include <thread>
-///single-threaded code
-/// @{
+#include <vector>
+
+#include "benchmark.hpp"
 
+/// Memory bound resource: construction builds a random cycle through 32 MiB (bench::pointer_chase), every use walks
+/// a fixed number of steps of it. Uses start at different nodes, so they miss the caches instead of rereading one path.
 struct heavy_resource
 {
-    heavy_resource(){ std::this_thread::sleep_for(std::chrono::seconds(2)); }
-    void do_something(){ std::this_thread::sleep_for(std::chrono::milliseconds(2)); }
+    static constexpr std::size_t bytes = 32 << 20;
+    static constexpr std::size_t steps_per_use = 32;
+
+    const bench::pointer_chase memory;
+    std::atomic<std::size_t> next_start;
+
+    heavy_resource() : memory(bytes), next_start(0) {}
+    void do_something()
+    {
+        const std::size_t start = this->next_start.fetch_add(this->memory.size() / 7 + 1, std::memory_order_relaxed);
+        this->memory.walk(start, steps_per_use);
+    }
 };
+
+///single-threaded code
+/// @{
+namespace single_threaded
+{
 std::shared_ptr<heavy_resource> resource_ptr;
 
 void single_thread_foo() 
@@ -17,10 +39,13 @@ void single_thread_foo()
     if(not resource_ptr) { resource_ptr.reset(new heavy_resource()); }
     resource_ptr->do_something();
 }
+} ///< namespace single_threaded
 /// @}
 
 ///thread-safe lazy initialization with mutex - unnecesary serialization
 /// @{
+namespace with_mutex
+{
 std::shared_ptr<heavy_resource> resource_ptr;
 std::mutex resource_mutex;
 void thread_safe_with_mutex_foo()
@@ -30,10 +55,13 @@ void thread_safe_with_mutex_foo()
     lk.unlock();
     resource_ptr->do_something();
 }
+} ///< namespace with_mutex
 /// @}
 
 ///thread-safe lazy initialization with mutex - double-checked locking pattern - bad idea
 /// @{
+namespace double_checked
+{
 std::shared_ptr<heavy_resource> resource_ptr;
 std::mutex resource_mutex;
 void double_checked_locking_foo()
@@ -46,10 +74,13 @@ void double_checked_locking_foo()
     }
     resource_ptr->do_something();
 }
+} ///< namespace double_checked
 /// @}
 
 ///thread-safe lazy initialization without mutex
 /// @{
+namespace with_call_once
+{
 std::shared_ptr<heavy_resource> resource_ptr;
 std::once_flag resource_flag;
 void thread_safe_without_mutex_foo()
@@ -58,12 +89,12 @@ void thread_safe_without_mutex_foo()
     std::call_once(resource_flag, init_resource);
     resource_ptr->do_something();
 }
+} ///< namespace with_call_once
 /// @}
 
 
 /// Bigger example
 /// @{
-#include <mutex>
 
 struct connection_info{};
 struct data_packet{};
@@ -109,5 +140,33 @@ public:
 };
 /// @}
 
-int main()
-{}
\ No newline at end of file
+/// Every thread calls foo calls_per_thread times. The resource is created once, normally in the warm-up run
+template<typename Func>
+void access_test(bench::harness& harness, const std::string& name, Func foo, const unsigned threads,
+                 const unsigned calls_per_thread)
+{
+    harness.run(name + " threads=" + std::to_string(threads), [&]{
+        std::vector<std::thread> workers;
+        for(unsigned t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&foo, calls_per_thread]{
+                for(unsigned i = 0; i < calls_per_thread; ++i) { foo(); }
+            });
+        }
+        for(std::thread& worker : workers) { worker.join(); }
+    }, threads * calls_per_thread);
+}
+
+int main(int argc, char** argv)
+{
+    bench::harness harness("lazy_initialization", argc, argv);
+    constexpr unsigned calls_per_thread = 10'000;
+    const unsigned threads = std::max(4u, std::thread::hardware_concurrency());
+    harness.run("single_threaded", []{
+        for(unsigned i = 0; i < calls_per_thread; ++i) { single_threaded::single_thread_foo(); }
+    }, calls_per_thread);
+    access_test(harness, "with_mutex", with_mutex::thread_safe_with_mutex_foo, threads, calls_per_thread);
+    access_test(harness, "with_call_once", with_call_once::thread_safe_without_mutex_foo, threads, calls_per_thread);
+    /// double_checked::double_checked_locking_foo is not measured - it is a data race (undefined behaviour)
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,373 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "cache_line.hpp"
+
+/// Whole map behind one mutex - every reader waits for every other reader and writer
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class globally_locked_table
+{
+private:
+    std::unordered_map<Key, Value, Hash> data;
+    mutable std::mutex m;
+public:
+    Value value_for(const Key& key, const Value& default_value = Value()) const
+    {
+        std::lock_guard<std::mutex> lock(m);
+        const auto found = data.find(key);
+        return found == data.end() ? default_value : found->second;
+    }
+    void add_or_update(const Key& key, const Value& value)
+    {
+        std::lock_guard<std::mutex> lock(m);
+        data[key] = value;
+    }
+    void remove(const Key& key)
+    {
+        std::lock_guard<std::mutex> lock(m);
+        data.erase(key);
+    }
+};
+
+/// Fixed number of buckets, each with its own reader/writer lock. Readers of one bucket dont block each other, and
+/// operations on different buckets dont touch the same lock at all. Number of buckets never changes, so no operation
+/// needs more than one lock (except snapshot).
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class threadsafe_lookup_table
+{
+private:
+    /// Bucket is padded, so locking one bucket doesnt invalidate cache line of its neighbour lock
+    class alignas(cache_line_size) bucket_type
+    {
+    private:
+        using bucket_value = std::pair<Key, Value>;
+        using bucket_data = std::list<bucket_value>;
+        using bucket_iterator = typename bucket_data::iterator;
+
+        bucket_data data;
+        mutable std::shared_mutex mutex;
+
+        bucket_iterator find_entry_for(const Key& key)
+        {
+            return std::find_if(data.begin(), data.end(), [&](const bucket_value& item){ return item.first == key; });
+        }
+        typename bucket_data::const_iterator find_entry_for(const Key& key) const
+        {
+            return std::find_if(data.begin(), data.end(), [&](const bucket_value& item){ return item.first == key; });
+        }
+
+    public:
+        Value value_for(const Key& key, const Value& default_value) const
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            const auto found_entry = find_entry_for(key);
+            return (found_entry == data.end()) ? default_value : found_entry->second;
+        }
+        void add_or_update(const Key& key, const Value& value)
+        {
+            std::unique_lock<std::shared_mutex> lock(mutex);
+            const bucket_iterator found_entry = find_entry_for(key);
+            if(found_entry == data.end()) { data.push_back(bucket_value(key, value)); }
+            else { found_entry->second = value; }
+        }
+        void remove(const Key& key)
+        {
+            std::unique_lock<std::shared_mutex> lock(mutex);
+            const bucket_iterator found_entry = find_entry_for(key);
+            if(found_entry != data.end()) { data.erase(found_entry); }
+        }
+
+        friend class threadsafe_lookup_table;
+    };
+
+    std::vector<std::unique_ptr<bucket_type>> buckets;
+    Hash hasher;
+
+    bucket_type& get_bucket(const Key& key) const
+    {
+        const std::size_t bucket_index = hasher(key) % buckets.size();
+        return *buckets[bucket_index];
+    }
+
+public:
+    /// Prime number of buckets spreads poor hashes (eg. identity hash of aligned pointers) better
+    explicit threadsafe_lookup_table(const unsigned num_buckets = 19, const Hash& hasher_ = Hash()) :
+        buckets(std::max(num_buckets, 1u)),
+        hasher(hasher_)
+    {
+        for(std::unique_ptr<bucket_type>& bucket : buckets) { bucket.reset(new bucket_type); }
+    }
+    threadsafe_lookup_table(const threadsafe_lookup_table&) = delete;
+    threadsafe_lookup_table& operator=(const threadsafe_lookup_table&) = delete;
+
+    Value value_for(const Key& key, const Value& default_value = Value()) const
+    {
+        return get_bucket(key).value_for(key, default_value);
+    }
+    void add_or_update(const Key& key, const Value& value)
+    {
+        get_bucket(key).add_or_update(key, value);
+    }
+    void remove(const Key& key)
+    {
+        get_bucket(key).remove(key);
+    }
+
+    /// Consistent copy of the whole table. Locks all buckets (always in the same order, so no deadlock with other
+    /// snapshots) and blocks writers until the copy is done.
+    std::map<Key, Value> snapshot() const
+    {
+        std::vector<std::shared_lock<std::shared_mutex>> locks;
+        locks.reserve(buckets.size());
+        for(const std::unique_ptr<bucket_type>& bucket : buckets) { locks.emplace_back(bucket->mutex); }
+
+        std::map<Key, Value> result;
+        for(const std::unique_ptr<bucket_type>& bucket : buckets)
+        {
+            result.insert(bucket->data.begin(), bucket->data.end());
+        }
+        return result;
+    }
+};
+
+/// Table for read-mostly workloads: readers take no lock and write nothing shared.
+/// Open addressing with linear probing over fixed number of slots. Each slot is guarded by its own version counter
+/// (seqlock): writer makes it odd before changing the slot and even again afterwards, reader retries if it saw odd
+/// version or version changed while it was copying the slot. Writers are serialized by one mutex - writes are rare.
+///
+/// Key and Value are kept in std::atomic, so they must be trivially copyable (ids, handles, pointers into
+/// long living storage). Slots never move, removed keys leave tombstones which later inserts reuse. Table doesnt
+/// grow - add_or_update throws std::length_error when it runs out of slots.
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class lock_free_read_table
+{
+private:
+    static_assert(std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value>,
+                  "lock_free_read_table stores keys and values in std::atomic");
+
+    enum slot_state : std::uint8_t { empty_slot, occupied_slot, deleted_slot };
+
+    struct slot
+    {
+        std::atomic<std::uint64_t> version{0};
+        std::atomic<std::uint8_t> state{empty_slot};
+        std::atomic<Key> key{};
+        std::atomic<Value> value{};
+    };
+
+    struct slot_copy
+    {
+        std::uint8_t state;
+        Key key;
+        Value value;
+    };
+
+    const std::size_t mask;
+    const std::unique_ptr<slot[]> slots;
+    Hash hasher;
+    mutable std::mutex write_mutex;
+    std::size_t used_slots; ///< occupied + tombstones, guarded by write_mutex
+
+    static std::size_t round_up_to_power_of_two(const std::size_t value)
+    {
+        std::size_t result = 1;
+        while(result < value) { result <<= 1; }
+        return result;
+    }
+
+    slot_copy read_slot(const slot& s) const
+    {
+        while(true)
+        {
+            const std::uint64_t before = s.version.load(std::memory_order_acquire);
+            if(before & 1) { continue; } ///< writer in progress
+            const slot_copy copy{s.state.load(std::memory_order_relaxed), s.key.load(std::memory_order_relaxed),
+                                 s.value.load(std::memory_order_relaxed)};
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(s.version.load(std::memory_order_relaxed) == before) { return copy; }
+        }
+    }
+
+    /// Writer side of the seqlock, called with write_mutex locked
+    template<typename Update>
+    static void write_slot(slot& s, Update update)
+    {
+        const std::uint64_t version = s.version.load(std::memory_order_relaxed);
+        s.version.store(version + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        update(s);
+        s.version.store(version + 2, std::memory_order_release);
+    }
+
+    /// Index of occupied slot holding key, or capacity() if there is none. Called with write_mutex locked.
+    std::size_t find_locked(const Key& key, std::size_t& first_free) const
+    {
+        first_free = capacity();
+        std::size_t index = hasher(key) & mask;
+        for(std::size_t probe = 0; probe <= mask; ++probe, index = (index + 1) & mask)
+        {
+            const slot& s = slots[index];
+            const std::uint8_t state = s.state.load(std::memory_order_relaxed);
+            if(state == empty_slot)
+            {
+                if(first_free == capacity()) { first_free = index; }
+                break;
+            }
+            if(state == deleted_slot) { if(first_free == capacity()) { first_free = index; } }
+            else if(s.key.load(std::memory_order_relaxed) == key) { return index; }
+        }
+        return capacity();
+    }
+
+public:
+    explicit lock_free_read_table(const std::size_t capacity_ = 1024, const Hash& hasher_ = Hash()) :
+        mask(round_up_to_power_of_two(std::max<std::size_t>(capacity_, 2)) - 1),
+        slots(new slot[mask + 1]),
+        hasher(hasher_),
+        used_slots(0)
+    {}
+    lock_free_read_table(const lock_free_read_table&) = delete;
+    lock_free_read_table& operator=(const lock_free_read_table&) = delete;
+
+    std::size_t capacity() const { return mask + 1; }
+
+    /// Lock-free, safe to call while writers run
+    Value value_for(const Key& key, const Value& default_value = Value()) const
+    {
+        std::size_t index = hasher(key) & mask;
+        for(std::size_t probe = 0; probe <= mask; ++probe, index = (index + 1) & mask)
+        {
+            const slot_copy copy = read_slot(slots[index]);
+            if(copy.state == empty_slot) { break; }
+            if(copy.state == occupied_slot && copy.key == key) { return copy.value; }
+        }
+        return default_value;
+    }
+
+    void add_or_update(const Key& key, const Value& value)
+    {
+        std::lock_guard<std::mutex> lock(write_mutex);
+        std::size_t first_free;
+        const std::size_t found = find_locked(key, first_free);
+        if(found != capacity())
+        {
+            write_slot(slots[found], [&value](slot& s){ s.value.store(value, std::memory_order_relaxed); });
+            return;
+        }
+        if(first_free == capacity()) { throw std::length_error("lock_free_read_table is full"); }
+
+        slot& target = slots[first_free];
+        /// keep at least one empty slot, so probing always terminates quickly for missing keys
+        const bool reuses_tombstone = target.state.load(std::memory_order_relaxed) == deleted_slot;
+        if(not reuses_tombstone && used_slots + 1 >= capacity()) { throw std::length_error("lock_free_read_table is full"); }
+        if(not reuses_tombstone) { ++used_slots; }
+        write_slot(target, [&key, &value](slot& s){
+            s.key.store(key, std::memory_order_relaxed);
+            s.value.store(value, std::memory_order_relaxed);
+            s.state.store(occupied_slot, std::memory_order_relaxed);
+        });
+    }
+
+    void remove(const Key& key)
+    {
+        std::lock_guard<std::mutex> lock(write_mutex);
+        std::size_t first_free;
+        const std::size_t found = find_locked(key, first_free);
+        if(found == capacity()) { return; }
+        write_slot(slots[found], [](slot& s){ s.state.store(deleted_slot, std::memory_order_relaxed); });
+    }
+
+    /// Consistent copy of the whole table. Blocks writers, but not readers.
+    std::map<Key, Value> snapshot() const
+    {
+        std::lock_guard<std::mutex> lock(write_mutex);
+        std::map<Key, Value> result;
+        for(std::size_t i = 0; i <= mask; ++i)
+        {
+            const slot& s = slots[i];
+            if(s.state.load(std::memory_order_relaxed) == occupied_slot)
+            {
+                result.emplace(s.key.load(std::memory_order_relaxed), s.value.load(std::memory_order_relaxed));
+            }
+        }
+        return result;
+    }
+};
+
+/// Session cache style load: every thread does read_ratio lookups per one update
+template<typename Table>
+void read_mostly_test(const std::string& name, const unsigned thread_count, const unsigned operations_per_thread,
+                      const unsigned read_ratio, const unsigned key_count)
+{
+    Table table;
+    for(unsigned key = 0; key < key_count; ++key) { table.add_or_update(key, key); }
+
+    std::atomic<unsigned long> hits(0);
+    const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for(unsigned i = 0; i < thread_count; ++i)
+    {
+        threads.emplace_back([&table, &hits, i, operations_per_thread, read_ratio, key_count](){
+            unsigned long local_hits = 0;
+            unsigned key = i;
+            for(unsigned op = 0; op < operations_per_thread; ++op)
+            {
+                key = (key * 1103515245u + 12345u) % key_count;
+                if(op % read_ratio == 0) { table.add_or_update(key, key); }
+                else if(table.value_for(key, key_count) == key) { ++local_hits; }
+            }
+            hits += local_hits;
+        });
+    }
+    for(std::thread& t : threads) { t.join(); }
+    const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    const unsigned long reads = static_cast<unsigned long>(thread_count) *
+                                (operations_per_thread - (operations_per_thread + read_ratio - 1) / read_ratio);
+    std::cout << name << " threads=" << thread_count << " hits_ok=" << (hits.load() == reads) << " time="
+              << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() << "[ms]" << std::endl;
+}
+
+int main()
+{
+    threadsafe_lookup_table<std::string, int> sessions;
+    sessions.add_or_update("alice", 1);
+    sessions.add_or_update("bob", 2);
+    sessions.add_or_update("alice", 3);
+    sessions.remove("bob");
+    for(const auto& entry : sessions.snapshot()) { std::cout << entry.first << " -> " << entry.second << std::endl; }
+    std::cout << "bob -> " << sessions.value_for("bob", -1) << std::endl;
+
+    lock_free_read_table<unsigned, unsigned> connections(16);
+    connections.add_or_update(7, 70);
+    connections.remove(7);
+    connections.add_or_update(8, 80);
+    std::cout << "7 -> " << connections.value_for(7) << " 8 -> " << connections.value_for(8)
+              << " size=" << connections.snapshot().size() << std::endl;
+
+    constexpr unsigned operations = 1000000;
+    constexpr unsigned read_ratio = 1000;
+    constexpr unsigned keys = 512;
+    for(const unsigned threads : {1u, 2u, 4u, 8u})
+    {
+        read_mostly_test<globally_locked_table<unsigned, unsigned>>("[globally_locked_table]", threads, operations, read_ratio, keys);
+        read_mostly_test<threadsafe_lookup_table<unsigned, unsigned>>("[threadsafe_lookup_table]", threads, operations, read_ratio, keys);
+        read_mostly_test<lock_free_read_table<unsigned, unsigned>>("[lock_free_read_table]", threads, operations, read_ratio, keys);
+    }
+}
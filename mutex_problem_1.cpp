@@ -1,5 +1,15 @@
 #include <mutex>
+#include <shared_mutex>
 #include <functional>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "distributed_shared_mutex.hpp"
+
 class some_data
 {
     int a;
@@ -13,12 +23,20 @@ class data_wrapper
 {
 private:
     some_data data;
-    std::mutex m;
+    mutable distributed_shared_mutex m;
 public:
     template<typename Function>
     void process_data(Function func)
     {
-        std::lock_guard<std::mutex> l(m);
+        std::unique_lock<distributed_shared_mutex> l(m);
+        func(data);
+    }
+
+    /// Readers only share the lock, func sees const data
+    template<typename Function>
+    void read_data(Function func) const
+    {
+        std::shared_lock<distributed_shared_mutex> l(m);
         func(data);
     }
 };
@@ -41,6 +59,47 @@ public:
     }
 };
 
+/// Readers hold shared lock for very short time, one writer updates now and then
+template<typename SharedMutex>
+void read_throughput_test(const std::string& name, SharedMutex& m, const unsigned readers, const unsigned reads_per_reader)
+{
+    long value = 0;
+    std::atomic<bool> done(false);
+    std::atomic<unsigned long> checksum(0);
+
+    const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    std::thread writer([&](){
+        while(not done.load())
+        {
+            {
+                std::unique_lock<SharedMutex> l(m);
+                ++value;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    std::vector<std::thread> threads;
+    for(unsigned i = 0; i < readers; ++i)
+    {
+        threads.emplace_back([&](){
+            unsigned long local = 0;
+            for(unsigned r = 0; r < reads_per_reader; ++r)
+            {
+                std::shared_lock<SharedMutex> l(m);
+                local += value;
+            }
+            checksum += local;
+        });
+    }
+    for(std::thread& t : threads) { t.join(); }
+    const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    done = true;
+    writer.join();
+
+    std::cout << name << " readers=" << readers << " time="
+              << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() << "[ms]" << std::endl;
+}
+
 int main()
 {
     data_wrapper x;
@@ -48,4 +107,15 @@ int main()
     auto malicious_function = std::bind(&SingleThreadedClass::do_something_with_data, &y, std::placeholders::_1);
     x.process_data(malicious_function);
     y.do_something_else();
+    x.read_data([](const some_data&){});
+
+    for(const unsigned readers : {1u, 2u, 4u, 8u})
+    {
+        std::shared_mutex shared_m;
+        distributed_shared_mutex reader_preferring_m;
+        distributed_shared_mutex writer_preferring_m(distributed_shared_mutex::preference::writers);
+        read_throughput_test("[std::shared_mutex]", shared_m, readers, 1000000);
+        read_throughput_test("[distributed_shared_mutex readers]", reader_preferring_m, readers, 1000000);
+        read_throughput_test("[distributed_shared_mutex writers]", writer_preferring_m, readers, 1000000);
+    }
 }
@@ -1,46 +1,59 @@
 #include <thread>
 #include <iostream>
 #include <mutex>
+#include <shared_mutex>
 #include <time.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "snapshot_cell.hpp"
+#include "distributed_shared_mutex.hpp"
+#include "hierarchical_mutex.hpp"
 class ThreadSafeData
 {
 private:
+    /// x is always locked before y: mtx_x has higher level, locking them the other way round is reported
+    using data_mutex = basic_hierarchical_mutex<distributed_shared_mutex>;
+
     struct{
         int x = 0;
         int y = 0;  
     } data;
-    mutable std::mutex mtx_x;
-    mutable std::mutex mtx_y;
+    mutable data_mutex mtx_x{200, "ThreadSafeData::mtx_x"};
+    mutable data_mutex mtx_y{100, "ThreadSafeData::mtx_y"};
 public:
     ThreadSafeData() = default;
     int getX() const 
     { 
-        std::lock_guard<std::mutex> lg(this->mtx_x);
-        this->data.x; 
+        std::shared_lock<data_mutex> lg(this->mtx_x);
+        return this->data.x;
     }
     int getY() const 
     {
-        std::lock_guard<std::mutex> lg(this->mtx_y); 
-        this->data.y; 
+        std::shared_lock<data_mutex> lg(this->mtx_y); 
+        return this->data.y;
     } 
 
     void setX(int x_) 
     {
-        std::lock_guard<std::mutex> lg(this->mtx_x);
+        std::lock_guard<data_mutex> lg(this->mtx_x);
         data.x = x_;
     }
     
     void setY(int y_) 
     {
-        std::lock_guard<std::mutex> lg(this->mtx_y); 
+        std::lock_guard<data_mutex> lg(this->mtx_y); 
         data.y = y_;
     }
 
     int processData()
     {
         // Bad because you lock for the whole scope. Process Data might take long time
-        std::lock_guard<std::mutex> lg_x(this->mtx_x);
-        std::lock_guard<std::mutex> lg_y(this->mtx_y); 
+        std::lock_guard<data_mutex> lg_x(this->mtx_x);
+        std::lock_guard<data_mutex> lg_y(this->mtx_y); 
         /// deadlock here
         int tmp_x = data.x;
         int tmp_y = data.y;
@@ -50,9 +63,10 @@ public:
 
     int processData2()
     {
-        std::unique_lock<std::mutex> lock_x(this->mtx_x, std::defer_lock);
-        std::unique_lock<std::mutex> lock_y(this->mtx_y, std::defer_lock);
-        std::lock(lock_x, lock_y);  ///<mutexes locked here
+        /// only reads, so shared locks are enough. std::lock would pick its own order, which hierarchy may
+        /// reject - with fixed order there is no deadlock anyway.
+        std::shared_lock<data_mutex> lock_x(this->mtx_x);
+        std::shared_lock<data_mutex> lock_y(this->mtx_y);  ///<mutexes locked here
 
         int tmp_x = data.x;
         int tmp_y = data.y;
@@ -63,13 +77,129 @@ public:
         std::this_thread::sleep_for(std::chrono::seconds(2));
         return tmp_x * tmp_y;
     }
+
+    /// Locks y before x. Together with processData it can deadlock, hierarchy catches it on first call.
+    int processDataWrongOrder()
+    {
+        std::lock_guard<data_mutex> lg_y(this->mtx_y);
+        std::lock_guard<data_mutex> lg_x(this->mtx_x);
+        return data.x * data.y;
+    }
+};
+
+/// Same interface as ThreadSafeData, but x and y live in one snapshot_cell. Every read sees consistent pair without
+/// taking any lock, so there is nothing to deadlock on and readers never stall writers.
+class SnapshotData
+{
+private:
+    struct point
+    {
+        int x = 0;
+        int y = 0;
+    };
+    snapshot_cell<point> data;
+public:
+    SnapshotData() = default;
+    int getX() const { return this->data.load().x; }
+    int getY() const { return this->data.load().y; }
+
+    void setX(int x_) { this->data.update([x_](point& p){ p.x = x_; }); }
+    void setY(int y_) { this->data.update([y_](point& p){ p.y = y_; }); }
+
+    int processData() const
+    {
+        const point p = this->data.load(); ///< consistent pair, processing runs without holding anything
+        return p.x * p.y;
+    }
+};
+
+/// Hot path reads small config millions of times, writer replaces it now and then. Config is consistent when
+/// checksum matches its fields, torn read would break that.
+template<typename Config>
+void config_reader_test(const std::string& name, const unsigned readers, const unsigned reads_per_reader)
+{
+    snapshot_cell<Config> config{Config(0)};
+    std::atomic<bool> done(false);
+    std::atomic<unsigned long> torn_reads(0);
+
+    const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    std::thread writer([&config, &done](){
+        for(int version = 1; not done.load(); ++version)
+        {
+            config.store(Config(version));
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    });
+    std::vector<std::thread> threads;
+    for(unsigned i = 0; i < readers; ++i)
+    {
+        threads.emplace_back([&config, &torn_reads, reads_per_reader](){
+            unsigned long torn = 0;
+            for(unsigned r = 0; r < reads_per_reader; ++r)
+            {
+                if(not config.read([](const Config& c){ return c.consistent(); })) { ++torn; }
+            }
+            torn_reads += torn;
+        });
+    }
+    for(std::thread& t : threads) { t.join(); }
+    const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    done = true;
+    writer.join();
+
+    std::cout << name << " readers=" << readers << " torn_reads=" << torn_reads.load() << " time="
+              << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() << "[ms]" << std::endl;
+}
+
+/// Trivially copyable - stored in seqlock
+struct small_config
+{
+    int timeout_ms;
+    int retries;
+    double backoff;
+    long checksum;
+    explicit small_config(int version = 0) : timeout_ms(version), retries(version * 2), backoff(version * 0.5),
+                                             checksum(4L * version) {}
+    bool consistent() const { return checksum == timeout_ms + retries + static_cast<long>(backoff * 2); }
+};
+
+/// Owns heap memory - stored behind RCU pointer swap
+struct named_config
+{
+    std::string name;
+    std::vector<int> limits;
+    explicit named_config(int version = 0) : name("config_" + std::to_string(version)), limits(8, version) {}
+    bool consistent() const { return name == "config_" + std::to_string(limits.back()); }
 };
 
 int main()
 {
     ThreadSafeData ts_data;
-    std::thread thread_update_x(&ThreadSafeData::setX, ts_data, 2);
-    std::thread thread_update_y(&ThreadSafeData::setY, ts_data, 3);
+    std::thread thread_update_x(&ThreadSafeData::setX, std::ref(ts_data), 2);
+    std::thread thread_update_y(&ThreadSafeData::setY, std::ref(ts_data), 3);
     std::thread thread_process([&ts_data](){ std::cout << ts_data.processData() << std::endl;});
+    thread_update_x.join();
+    thread_update_y.join();
+    thread_process.join();
+    try
+    {
+        std::cout << ts_data.processDataWrongOrder() << std::endl;
+    }
+    catch(const std::logic_error& e)
+    {
+        std::cout << e.what() << std::endl;
+    }
+
+    SnapshotData snapshot_data;
+    std::thread snapshot_update_x(&SnapshotData::setX, std::ref(snapshot_data), 2);
+    std::thread snapshot_update_y(&SnapshotData::setY, std::ref(snapshot_data), 3);
+    std::thread snapshot_process([&snapshot_data](){ std::cout << snapshot_data.processData() << std::endl;});
+    snapshot_update_x.join();
+    snapshot_update_y.join();
+    snapshot_process.join();
+    std::cout << "x=" << snapshot_data.getX() << " y=" << snapshot_data.getY() << std::endl;
+
+    config_reader_test<small_config>("[seqlock small_config]", 4, 1000000);
+    config_reader_test<named_config>("[rcu named_config]", 4, 200000);
     return 0;
 }
\ No newline at end of file
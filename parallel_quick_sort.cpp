@@ -1,6 +1,5 @@
 #include <iostream>
 #include <list>
-#include <stack>
 #include <vector>
 #include <random>
 #include <algorithm>
@@ -8,173 +7,483 @@
 #include <thread>
 #include <future>
 #include <cassert>
-
-struct empty_stack: public std::exception
+#include <functional>
+#include <iterator>
+#include <array>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+#include <sstream>
+#include <string>
+
+#include "benchmark.hpp"
+#include "thread_pool.hpp"
+
+/// How QuickSorter divides chunk around pivot
+enum class partition_mode
 {
-    const char* what() const throw()
-    {
-        return "empty stack";
-    }
+    two_way,    ///< [< pivot] [>= pivot], keys equal to pivot are sorted again on every level
+    three_way   ///< Dutch national flag: [< pivot] [== pivot] [> pivot], equal keys are done after one pass
 };
 
-/// Threadsafe wrapper around std::stack
+/// Parallel quick_sort algorithm.
+/// Lower part of every partition is submitted to the work-stealing pool, higher part is sorted by current thread.
+/// While waiting for lower part, thread executes other pending chunks instead of blocking.
 template<typename T>
-class threadsafe_stack
+class QuickSorter
 {
 private:
-    std::stack<T> data;
-    mutable std::mutex m;
+    using iterator = typename std::list<T>::iterator;
+
+    thread_pool& pool;
+    const partition_mode mode;
+
+    /// Pivot is median of evenly spaced samples. Sample count grows with chunk size, so big chunks get pivot close
+    /// to real median while small ones dont pay for sampling.
+    iterator select_pivot(std::list<T>& chunk_data)
+    {
+        const std::size_t size = chunk_data.size();
+        const std::size_t sample_count = size < 32 ? 1 : size < 1024 ? 3 : size < 65536 ? 9 : 27;
+        if(sample_count == 1) { return chunk_data.begin(); }
+
+        std::vector<iterator> samples;
+        samples.reserve(sample_count);
+        const std::size_t step = size / sample_count;
+        iterator it = chunk_data.begin();
+        for(std::size_t i = 0; i < sample_count; ++i, std::advance(it, step)) { samples.push_back(it); }
+
+        const auto middle = samples.begin() + sample_count / 2;
+        std::nth_element(samples.begin(), middle, samples.end(), [](iterator a, iterator b){ return *a < *b; });
+        return *middle;
+    }
+
 public:
-    threadsafe_stack()=default;
-    threadsafe_stack(const threadsafe_stack& other)
+    explicit QuickSorter(thread_pool& pool_, const partition_mode mode_ = partition_mode::three_way) :
+        pool(pool_),
+        mode(mode_)
+    {}
+
+    std::list<T> do_sort(std::list<T>& chunk_data)
     {
-        std::lock_guard<std::mutex> lock(other.m);
-        data=other.data;
+        if(chunk_data.empty()) { return chunk_data; }
+
+        std::list<T> result;
+        result.splice(result.begin(), chunk_data, select_pivot(chunk_data));
+        const T& partition_val =* result.begin();
+
+        /// divide data based on pivot
+        iterator divide_point = std::partition(chunk_data.begin(), chunk_data.end(),
+                                               [&](const T& val){return val < partition_val;});
+        std::list<T> new_lower_data;
+        new_lower_data.splice(new_lower_data.end(), chunk_data,chunk_data.begin(), divide_point);
+
+        if(this->mode == partition_mode::three_way)
+        {
+            /// keys equal to pivot are already in final place, remove them from further recursion
+            const iterator equal_end = std::partition(chunk_data.begin(), chunk_data.end(),
+                                                      [&](const T& val){return not (partition_val < val);});
+            result.splice(result.end(), chunk_data, chunk_data.begin(), equal_end);
+        }
+
+        std::future<std::list<T>> new_lower = this->pool.submit(
+            [this, data = std::move(new_lower_data)]() mutable { return this->do_sort(data); });
+
+        std::list<T> new_higher(this->do_sort(chunk_data));
+        result.splice(result.end(), new_higher);
+        this->pool.wait(new_lower);
+
+        result.splice(result.begin(),new_lower.get());
+        return result;
     }
-    threadsafe_stack& operator=(const threadsafe_stack&) = delete;
+};
+
+template<typename T>
+std::list<T> parallel_quick_sort(std::list<T> input, const partition_mode mode = partition_mode::three_way)
+{
+    if(input.empty()) { return input; }
+    thread_pool& pool = default_thread_pool();
+    QuickSorter<T> s(pool, mode);
+    /// start inside the pool, so chunks go to worker deques instead of shared injection queue
+    return pool.submit([&s, &input](){ return s.do_sort(input); }).get();
+}
+
+/// In-place parallel quick_sort over random access range (std::vector, array, pointer range).
+/// Partitions in place, so unlike QuickSorter it allocates nothing per element. Small ranges are finished with
+/// insertion sort and only ranges above grain_size are handed to the pool.
+template<typename RandomIt, typename Compare>
+class InPlaceQuickSorter
+{
+private:
+    using difference_type = typename std::iterator_traits<RandomIt>::difference_type;
 
-    void push(const T& new_value)
+    static constexpr difference_type insertion_sort_cutoff = 32;
+    static constexpr difference_type ninther_threshold = 128;
+
+    thread_pool& pool;
+    const difference_type grain_size;
+    Compare comp;
+
+    void insertion_sort(RandomIt first, RandomIt last)
     {
-        std::lock_guard<std::mutex> lock(m);
-        data.push(new_value);
+        if(first == last) { return; }
+        for(RandomIt i = first + 1; i != last; ++i)
+        {
+            typename std::iterator_traits<RandomIt>::value_type value = std::move(*i);
+            RandomIt hole = i;
+            for(; hole != first && this->comp(value, *(hole - 1)); --hole) { *hole = std::move(*(hole - 1)); }
+            *hole = std::move(value);
+        }
     }
 
-    void push(T&& new_value)
+    /// orders three elements so that *a <= *b <= *c
+    void sort3(RandomIt a, RandomIt b, RandomIt c)
     {
-        std::lock_guard<std::mutex> lock(m);
-        data.emplace(std::move(new_value));
+        if(this->comp(*b, *a)) { std::iter_swap(a, b); }
+        if(this->comp(*c, *b))
+        {
+            std::iter_swap(b, c);
+            if(this->comp(*b, *a)) { std::iter_swap(a, b); }
+        }
     }
 
-    std::shared_ptr<T> pop()
+    /// Moves pivot to *first. Median-of-three for small ranges, Tukey's ninther for big ones.
+    void select_pivot(RandomIt first, RandomIt last)
     {
-        std::lock_guard<std::mutex> lock(m);
-        if(data.empty()) { return std::shared_ptr<T>(); }
-        std::shared_ptr<T> const res(std::make_shared<T>(std::move(data.top())));
-        data.pop();
-        return res;
+        const difference_type size = last - first;
+        const RandomIt middle = first + size / 2;
+        if(size > ninther_threshold)
+        {
+            const difference_type step = size / 8;
+            sort3(first, first + step, first + 2 * step);
+            sort3(middle - step, middle, middle + step);
+            sort3(last - 1 - 2 * step, last - 1 - step, last - 1);
+            sort3(first + step, middle, last - 1 - step);
+        }
+        else
+        {
+            sort3(first, middle, last - 1);
+        }
+        std::iter_swap(first, middle);
     }
 
-    void pop(T& value)
+    /// Hoare partition around *first. Elements equal to pivot are split between both sides, so duplicates
+    /// dont unbalance the recursion. Returns final position of pivot.
+    RandomIt partition(RandomIt first, RandomIt last)
     {
-        std::lock_guard<std::mutex> lock(m);
-        if(data.empty()) { throw empty_stack(); }
-        value=std::move(data.top());
-        data.pop();
+        select_pivot(first, last);
+        RandomIt i = first + 1;
+        RandomIt j = last - 1;
+        while(true)
+        {
+            while(i <= j && this->comp(*i, *first)) { ++i; }
+            while(i <= j && this->comp(*first, *j)) { --j; }
+            if(i >= j) { break; }
+            std::iter_swap(i++, j--);
+        }
+        std::iter_swap(first, j);
+        return j;
     }
-    
-    bool empty() const
+
+public:
+    InPlaceQuickSorter(thread_pool& pool_, const difference_type grain_size_, Compare comp_) :
+        pool(pool_),
+        grain_size(std::max(grain_size_, insertion_sort_cutoff)),
+        comp(comp_)
+    {}
+
+    void do_sort(RandomIt first, RandomIt last)
     {
-        std::lock_guard<std::mutex> lock(m);
-        return data.empty();
+        std::vector<std::future<void>> pending;
+        while(last - first > insertion_sort_cutoff)
+        {
+            const RandomIt middle = partition(first, last);
+            if(last - first > this->grain_size)
+            {
+                /// left part goes to the pool, current thread continues with right part
+                pending.push_back(this->pool.submit([this, first, middle](){ this->do_sort(first, middle); }));
+                first = middle + 1;
+            }
+            else if(middle - first < last - middle)
+            {
+                /// recurse into smaller part, loop on bigger one - stack depth stays O(log n)
+                do_sort(first, middle);
+                first = middle + 1;
+            }
+            else
+            {
+                do_sort(middle + 1, last);
+                last = middle;
+            }
+        }
+        insertion_sort(first, last);
+
+        for(std::future<void>& f : pending)
+        {
+            this->pool.wait(f);
+            f.get();
+        }
     }
 };
 
-/// Parallel quick_sort algorithm.
-/// Separates data to chunks and process them in parallel. Implementation based on promises.
+template<typename RandomIt, typename Compare = std::less<>>
+void parallel_quick_sort(RandomIt first, RandomIt last, Compare comp = Compare(),
+                         const typename std::iterator_traits<RandomIt>::difference_type grain_size = 16384)
+{
+    if(last - first < 2) { return; }
+    thread_pool& pool = default_thread_pool();
+    InPlaceQuickSorter<RandomIt, Compare> s(pool, grain_size, comp);
+    pool.submit([&s, first, last](){ s.do_sort(first, last); }).get();
+}
+
 template<typename T>
-class QuickSorter
+void parallel_quick_sort(std::vector<T>& data)
+{
+    parallel_quick_sort(data.begin(), data.end());
+}
+
+/// Parallel stable merge sort.
+/// Halves are sorted in parallel and merged in parallel: bigger input is split at its middle element, the other one
+/// at lower/upper bound of that element, and both halves of the output are merged independently.
+/// Data moves between range and buffer on alternating levels, so every level costs one pass over memory.
+template<typename RandomIt, typename Compare>
+class ParallelMergeSorter
 {
 private:
-    /// contains part of data to sort and associated promise. Movable only.
-    struct chunk_to_sort
-    {
-        std::list<T> data;
-        std::promise<std::list<T>> promise;
-
-        chunk_to_sort(){}
-        /// std::promise is only movable 
-        chunk_to_sort(const chunk_to_sort& other)=delete;
-        chunk_to_sort(chunk_to_sort&& other) 
-            : promise(std::move(other.promise)),
-              data(std::move(other.data))
-            {}
-    };
-
-    std::atomic<bool> end_of_data;
-    const unsigned max_thread_count;
-    std::vector<std::thread> threads;
-    threadsafe_stack<chunk_to_sort> chunks;
-
-    /// get new chunk from stack and sort
-    void try_sort_chunk()
-    {
-        std::shared_ptr<chunk_to_sort> chunk = this->chunks.pop();
-        if(chunk) { sort_chunk(chunk); }
-    }
+    using value_type = typename std::iterator_traits<RandomIt>::value_type;
+    using difference_type = typename std::iterator_traits<RandomIt>::difference_type;
+    using buffer_iterator = typename std::vector<value_type>::iterator;
 
-    void sort_chunk(const std::shared_ptr<chunk_to_sort>& chunk)
+    thread_pool& pool;
+    const difference_type grain_size;
+    Compare comp;
+
+    /// Stable merge of [first_1, last_1) and [first_2, last_2) into out. Ties are taken from first range.
+    template<typename InputIt, typename OutputIt>
+    void merge(InputIt first_1, InputIt last_1, InputIt first_2, InputIt last_2, OutputIt out)
     {
-        chunk->promise.set_value(do_sort(chunk->data));
+        const difference_type size_1 = last_1 - first_1;
+        const difference_type size_2 = last_2 - first_2;
+        if(size_1 + size_2 <= this->grain_size)
+        {
+            std::merge(std::make_move_iterator(first_1), std::make_move_iterator(last_1),
+                       std::make_move_iterator(first_2), std::make_move_iterator(last_2), out, this->comp);
+            return;
+        }
+
+        InputIt split_1, split_2;
+        if(size_1 >= size_2)
+        {
+            split_1 = first_1 + size_1 / 2;
+            split_2 = std::lower_bound(first_2, last_2, *split_1, this->comp); ///< equal keys of 2nd range go after
+        }
+        else
+        {
+            split_2 = first_2 + size_2 / 2;
+            split_1 = std::upper_bound(first_1, last_1, *split_2, this->comp); ///< equal keys of 1st range go before
+        }
+        const OutputIt out_split = out + (split_1 - first_1) + (split_2 - first_2);
+
+        std::future<void> lower = this->pool.submit([this, first_1, split_1, first_2, split_2, out](){
+            this->merge(first_1, split_1, first_2, split_2, out);
+        });
+        merge(split_1, last_1, split_2, last_2, out_split);
+        this->pool.wait(lower);
+        lower.get();
     }
 
-    /// worker thread function
-    void sort_thread()
+    /// Sorts [first, last). Result ends in [first, last) or, if to_buffer is set, in buffer range of the same size.
+    void sort(RandomIt first, RandomIt last, buffer_iterator buffer, const bool to_buffer)
     {
-        while(not this->end_of_data)
+        const difference_type size = last - first;
+        if(size <= this->grain_size)
         {
-            try_sort_chunk();
-            std::this_thread::yield();
+            std::stable_sort(first, last, this->comp);
+            if(to_buffer) { std::move(first, last, buffer); }
+            return;
         }
+
+        const difference_type half = size / 2;
+        const RandomIt middle = first + half;
+        std::future<void> lower = this->pool.submit([this, first, middle, buffer, to_buffer](){
+            this->sort(first, middle, buffer, not to_buffer);
+        });
+        sort(middle, last, buffer + half, not to_buffer);
+        this->pool.wait(lower);
+        lower.get();
+
+        /// halves are now in the other storage, merge them into the requested one
+        if(to_buffer) { merge(first, middle, middle, last, buffer); }
+        else { merge(buffer, buffer + half, buffer + half, buffer + size, first); }
     }
 
 public:
-    QuickSorter():
-        max_thread_count(std::thread::hardware_concurrency()-1),
-        end_of_data(false)
+    ParallelMergeSorter(thread_pool& pool_, const difference_type grain_size_, Compare comp_) :
+        pool(pool_),
+        grain_size(std::max<difference_type>(grain_size_, 2)),
+        comp(comp_)
+    {}
+
+    void do_sort(RandomIt first, RandomIt last)
     {
-        this->threads.reserve(this->max_thread_count);
+        std::vector<value_type> buffer(last - first);
+        sort(first, last, buffer.begin(), false);
     }
+};
 
-    ~QuickSorter()
+template<typename RandomIt, typename Compare = std::less<>>
+void parallel_merge_sort(RandomIt first, RandomIt last, Compare comp = Compare(),
+                         const typename std::iterator_traits<RandomIt>::difference_type grain_size = 16384)
+{
+    if(last - first < 2) { return; }
+    thread_pool& pool = default_thread_pool();
+    ParallelMergeSorter<RandomIt, Compare> s(pool, grain_size, comp);
+    pool.submit([&s, first, last](){ s.do_sort(first, last); }).get();
+}
+
+/// Maps arithmetic value to unsigned key with the same ordering. Signed integers get sign bit flipped, negative
+/// floats get all bits flipped and positive ones only the sign bit.
+template<typename T>
+auto to_radix_key(const T value)
+{
+    static_assert(std::is_arithmetic<T>::value, "radix sort needs integral or floating point keys");
+    if constexpr(std::is_floating_point<T>::value)
     {
-        this->end_of_data = true;
-        for(unsigned i = 0; i < this->threads.size(); ++i) 
-        { 
-            if(this->threads[i].joinable()) { this->threads[i].join(); } 
-        }
+        static_assert(sizeof(T) == 4 || sizeof(T) == 8, "only float and double are supported");
+        using key_type = typename std::conditional<sizeof(T) == 4, std::uint32_t, std::uint64_t>::type;
+        key_type bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        const key_type sign_bit = key_type(1) << (sizeof(key_type) * 8 - 1);
+        return static_cast<key_type>((bits & sign_bit) ? ~bits : (bits | sign_bit));
     }
-
-    std::list<T> do_sort(std::list<T>& chunk_data)
+    else if constexpr(std::is_signed<T>::value)
     {
-        if(chunk_data.empty()) { return chunk_data; }
+        using key_type = typename std::make_unsigned<T>::type;
+        return static_cast<key_type>(static_cast<key_type>(value) ^ (key_type(1) << (sizeof(key_type) * 8 - 1)));
+    }
+    else
+    {
+        return value;
+    }
+}
 
-        std::list<T> result;
-        result.splice(result.begin(), chunk_data, chunk_data.begin());
-        const T& partition_val =* result.begin();
+/// Parallel LSD radix sort with 8 bit digits for integral and floating point values.
+/// Every pass: each block builds its own histogram, histograms are turned into per block output offsets, and blocks
+/// scatter their elements to the buffer in parallel. Order inside a digit is kept, so passes compose.
+/// Digits which are equal for all keys (eg. high bytes of small numbers) are skipped, so heavily duplicated
+/// keys from a small range need only one or two passes.
+template<typename T>
+class ParallelRadixSorter
+{
+private:
+    static constexpr unsigned radix_bits = 8;
+    static constexpr unsigned buckets = 1u << radix_bits;
+    static constexpr unsigned passes = sizeof(T) * 8 / radix_bits;
 
-        /// divide data based on pivot
-        typename std::list<T>::iterator divide_point = std::partition(chunk_data.begin(), chunk_data.end(),
-                                                           [&](const T& val){return val < partition_val;});
-        chunk_to_sort new_lower_chunk;
-        new_lower_chunk.data.splice(new_lower_chunk.data.end(), chunk_data,chunk_data.begin(), divide_point);
-
-        std::future<std::list<T>> new_lower = new_lower_chunk.promise.get_future();
-        this->chunks.push(std::move(new_lower_chunk));
-        
-        /// spawn new worker if possible
-        if(this->threads.size() < this->max_thread_count) 
-        { 
-            this->threads.emplace_back(&QuickSorter<T>::sort_thread, this);
+    using histogram = std::array<std::size_t, buckets>;
+
+    thread_pool& pool;
+    const std::size_t grain_size;
+
+    static unsigned digit(const T value, const unsigned pass)
+    {
+        return static_cast<unsigned>((to_radix_key(value) >> (pass * radix_bits)) & (buckets - 1));
+    }
+
+    /// Runs f(block_first, block_last, block_index) for every block, first block on calling thread
+    template<typename Func>
+    void for_each_block(const std::size_t size, const std::size_t num_blocks, Func f)
+    {
+        const std::size_t block_size = (size + num_blocks - 1) / num_blocks;
+        std::vector<std::future<void>> pending;
+        pending.reserve(num_blocks - 1);
+        for(std::size_t block = 1; block < num_blocks; ++block)
+        {
+            const std::size_t block_first = std::min(size, block * block_size);
+            const std::size_t block_last = std::min(size, block_first + block_size);
+            pending.push_back(this->pool.submit([=, &f](){ f(block_first, block_last, block); }));
         }
-        
-        std::list<T> new_higher(this->do_sort(chunk_data));
-        result.splice(result.end(), new_higher);
-        while(new_lower.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        f(0, std::min(size, block_size), 0);
+        for(std::future<void>& fut : pending)
         {
-            try_sort_chunk();
+            this->pool.wait(fut);
+            fut.get();
         }
+    }
 
-        result.splice(result.begin(),new_lower.get());
-        return result;
+public:
+    ParallelRadixSorter(thread_pool& pool_, const std::size_t grain_size_) :
+        pool(pool_),
+        grain_size(std::max<std::size_t>(grain_size_, 1))
+    {}
+
+    void do_sort(T* data, const std::size_t size)
+    {
+        const std::size_t num_blocks = std::max<std::size_t>(
+            1, std::min<std::size_t>(this->pool.size() + 1, size / this->grain_size));
+
+        /// global histograms of all digits in one read, to find passes that would not move anything
+        std::vector<std::array<histogram, passes>> block_totals(num_blocks);
+        for_each_block(size, num_blocks, [&](const std::size_t first, const std::size_t last, const std::size_t block){
+            std::array<histogram, passes>& totals = block_totals[block];
+            for(histogram& h : totals) { h.fill(0); }
+            for(std::size_t i = first; i < last; ++i)
+            {
+                for(unsigned pass = 0; pass < passes; ++pass) { ++totals[pass][digit(data[i], pass)]; }
+            }
+        });
+
+        std::vector<T> buffer(size);
+        T* src = data;
+        T* dst = buffer.data();
+        std::vector<histogram> offsets(num_blocks);
+        for(unsigned pass = 0; pass < passes; ++pass)
+        {
+            bool trivial = false;
+            for(unsigned d = 0; d < buckets && not trivial; ++d)
+            {
+                std::size_t count = 0;
+                for(const std::array<histogram, passes>& totals : block_totals) { count += totals[pass][d]; }
+                trivial = count == size;
+            }
+            if(trivial) { continue; }
+
+            /// per block histograms of current layout
+            for_each_block(size, num_blocks, [&](const std::size_t first, const std::size_t last, const std::size_t block){
+                histogram& h = offsets[block];
+                h.fill(0);
+                for(std::size_t i = first; i < last; ++i) { ++h[digit(src[i], pass)]; }
+            });
+
+            /// exclusive scan in (digit, block) order turns counts into output offsets
+            std::size_t sum = 0;
+            for(unsigned d = 0; d < buckets; ++d)
+            {
+                for(histogram& h : offsets)
+                {
+                    const std::size_t count = h[d];
+                    h[d] = sum;
+                    sum += count;
+                }
+            }
+
+            for_each_block(size, num_blocks, [&](const std::size_t first, const std::size_t last, const std::size_t block){
+                histogram& h = offsets[block];
+                for(std::size_t i = first; i < last; ++i) { dst[h[digit(src[i], pass)]++] = src[i]; }
+            });
+            std::swap(src, dst);
+        }
+
+        if(src != data) { std::copy(src, src + size, data); }
     }
 };
 
 template<typename T>
-std::list<T> parallel_quick_sort(std::list<T> input)
+void parallel_radix_sort(std::vector<T>& data, const std::size_t grain_size = 65536)
 {
-    if(input.empty()) { return input; }
-    QuickSorter<T> s;
-    return s.do_sort(input);
+    if(data.size() < 2) { return; }
+    thread_pool& pool = default_thread_pool();
+    ParallelRadixSorter<T> s(pool, grain_size);
+    pool.submit([&s, &data](){ s.do_sort(data.data(), data.size()); }).get();
 }
 
 template<typename Numeric, typename Generator = std::mt19937>
@@ -206,61 +515,97 @@ std::list<T> create_random_list(const size_t size, const T min, const T max)
     return random_list;
 }
 
-template<typename T>
-void print_data(const std::list<T>& data)
+template<class T>
+std::vector<T> create_random_vector(const size_t size, const T min, const T max)
 {
-    std::cout << "Data: [";
-    for(const T& element : data) { std::cout << element << ", "; }
-    std::cout << "]" << std::endl << std::endl;
+    std::vector<T> random_vector;
+    random_vector.reserve(size);
+    for(size_t i = 0; i < size; ++i) { random_vector.push_back(generate_random_value<T>(min, max)); }
+    return random_vector;
 }
 
-struct ScopedTimerMs
+template<typename Container>
+void print_data(const Container& data)
 {
-    typedef std::chrono::steady_clock::time_point time_point;
-    const std::string name;
-    const time_point begin;
-
-    ScopedTimerMs(const std::string& name_) : 
-        name(name_),
-        begin(std::chrono::steady_clock::now())
-    {}
-    ~ScopedTimerMs()
-    {
-        const time_point end = std::chrono::steady_clock::now();
-        std::cout << this->name << " time=" << 
-            std::chrono::duration_cast<std::chrono::milliseconds>(end - this->begin).count() << "[ms]" << std::endl;
-    }
-};
+    std::cout << "Data: [";
+    for(const auto& element : data) { std::cout << element << ", "; }
+    std::cout << "]" << std::endl << std::endl;
+}
 
 template<typename T, bool print = false>
-void perform_test(const size_t size, const T min, const T max)
+void perform_test(bench::harness& harness, const size_t size, const T min, const T max,
+                  const partition_mode mode = partition_mode::three_way)
 {
     std::cout << __PRETTY_FUNCTION__ << std::endl;
-    std::list<T> test_data = create_random_list<T>(std::move(size), std::move(min), std::move(max));
+    const std::list<T> test_data = create_random_list<T>(size, min, max);
     if(print) { print_data(test_data); }
+    const std::string suffix = std::string(mode == partition_mode::two_way ? " two_way" : " three_way") +
+                               " size=" + std::to_string(size);
 
+    /// two_way partitioning degrades on many equal keys, that case is measured once
+    const bench::options& settings = harness.settings();
+    const bench::limits cap = mode == partition_mode::two_way ? bench::limits{0, 1}
+                                                              : bench::limits{settings.warmup, settings.repetitions};
     std::list<T> parallel_sorted_data;
-    {
-        ScopedTimerMs timer("parallel_sorted_data");
-        parallel_sorted_data = parallel_quick_sort(test_data);
-        if(print) { print_data(parallel_sorted_data); }
-    }
-    
-    std::list<T> sequential_sorted_data(test_data); ///< prepare data
-    {
-        ScopedTimerMs timer("sequential_sorted_data");
-        sequential_sorted_data.sort();
-        if(print) { print_data(sequential_sorted_data); }
-    }
+    harness.run("parallel_quick_sort(list)" + suffix, [&]{ parallel_sorted_data = parallel_quick_sort(test_data, mode); },
+                size, cap);
+    if(print) { print_data(parallel_sorted_data); }
+
+    std::list<T> sequential_sorted_data;
+    harness.run_with_setup("list::sort" + suffix, [&]{ sequential_sorted_data = test_data; },
+                           [&]{ sequential_sorted_data.sort(); }, size);
+    if(print) { print_data(sequential_sorted_data); }
+
+    assert(parallel_sorted_data == sequential_sorted_data); ///< sorted data should be exactly the same
+}
+
+template<typename T, bool print = false, typename SortFn>
+void perform_vector_test(bench::harness& harness, const std::string& name, SortFn sort_fn, const size_t size,
+                         const T min, const T max)
+{
+    std::cout << name << " size=" << size << " range=[" << min << ", " << max << "]" << std::endl;
+    const std::vector<T> test_data = create_random_vector<T>(size, min, max);
+    if(print) { print_data(test_data); }
+    std::ostringstream suffix;
+    suffix << " size=" << size << " range=[" << min << ", " << max << "]";
+
+    std::vector<T> parallel_sorted_data;
+    harness.run_with_setup(name + suffix.str(), [&]{ parallel_sorted_data = test_data; },
+                           [&]{ sort_fn(parallel_sorted_data); }, size);
+    if(print) { print_data(parallel_sorted_data); }
+
+    std::vector<T> sequential_sorted_data;
+    harness.run_with_setup("std::sort" + suffix.str(), [&]{ sequential_sorted_data = test_data; },
+                           [&]{ std::sort(sequential_sorted_data.begin(), sequential_sorted_data.end()); }, size);
+    if(print) { print_data(sequential_sorted_data); }
 
     assert(parallel_sorted_data == sequential_sorted_data); ///< sorted data should be exactly the same
 }
 
-int main()
+template<typename T, bool print = false>
+void perform_vector_tests(bench::harness& harness, const size_t size, const T min, const T max)
 {
-    // perform_test<int, true>(50, 0, 1000);
-    // perform_test<int>(50000, 0, 1000);
-    // perform_test<double>(50, 0.0, 1000.0);
-    // perform_test<float>(50, 0.0f, 1000.0f);
-    perform_test<int>(1000000, 0, 1000);
-}
\ No newline at end of file
+    perform_vector_test<T, print>(harness, "parallel_quick_sort",
+        [](std::vector<T>& data){ parallel_quick_sort(data); }, size, min, max);
+    perform_vector_test<T, print>(harness, "parallel_merge_sort",
+        [](std::vector<T>& data){ parallel_merge_sort(data.begin(), data.end()); }, size, min, max);
+    perform_vector_test<T, print>(harness, "parallel_radix_sort",
+        [](std::vector<T>& data){ parallel_radix_sort(data); }, size, min, max);
+}
+
+int main(int argc, char** argv)
+{
+    bench::harness harness("parallel_quick_sort", argc, argv);
+    // perform_test<int, true>(harness, 50, 0, 1000);
+    // perform_test<int>(harness, 50000, 0, 1000);
+    // perform_test<double>(harness, 50, 0.0, 1000.0);
+    // perform_test<float>(harness, 50, 0.0f, 1000.0f);
+    perform_test<int>(harness, 1000000, 0, 1000);
+    perform_test<int>(harness, 1000000, 0, 1000, partition_mode::two_way);
+
+    // perform_vector_tests<int, true>(harness, 50, 0, 1000);
+    perform_vector_tests<int>(harness, 1000000, 0, 1000);
+    perform_vector_tests<int>(harness, 1000000, -1000000000, 1000000000);
+    perform_vector_tests<long long>(harness, 1000000, -1000000000000LL, 1000000000000LL);
+    perform_vector_tests<double>(harness, 1000000, -1000.0, 1000.0);
+}
@@ -6,6 +6,19 @@
 #include <iostream>
 #include <chrono>
 #include <future>
+#include <cstdint>
+#include <type_traits>
+#include <iterator>
+#include <string>
+#include <cmath>
+#include <limits>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "thread_pool.hpp"
+#include "benchmark.hpp"
+#include "cache_line.hpp"
 
 template<typename Iterator,typename T>
 struct accumulate_block
@@ -19,14 +32,182 @@ struct accumulate_block
 template<typename Iterator,typename T>
 struct accumulate_block_for_async
 {
-    int operator()(Iterator first,Iterator last)
+    T operator()(Iterator first,Iterator last)
     {
-        int result;
-        std::accumulate(first,last,result);
-        return result;
+        return std::accumulate(first,last,T());
     }
 };
 
+/// Accumulator wide enough to sum many elements without overflow/precision loss
+template<typename T, typename = void>
+struct wide_accumulator { using type = T; };
+
+template<typename T>
+struct wide_accumulator<T, typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type>
+{ using type = std::int64_t; };
+
+template<typename T>
+struct wide_accumulator<T, typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value>::type>
+{ using type = std::uint64_t; };
+
+template<>
+struct wide_accumulator<float> { using type = double; };
+
+template<typename T>
+using wide_accumulator_t = typename wide_accumulator<T>::type;
+
+/// Summation kernels over contiguous memory.
+/// AVX2/SSE versions are picked at compile time (build with -mavx2 or -march=native), everything else uses scalar
+/// loop with four independent accumulators, which compiler is free to vectorize.
+/// Note: vector kernels add floating point values in different order than std::accumulate.
+namespace simd
+{
+template<typename Acc, typename T>
+Acc sum_scalar(const T* first, const T* last)
+{
+    Acc acc_0 = Acc(), acc_1 = Acc(), acc_2 = Acc(), acc_3 = Acc();
+    for(; last - first >= 4; first += 4)
+    {
+        acc_0 += static_cast<Acc>(first[0]);
+        acc_1 += static_cast<Acc>(first[1]);
+        acc_2 += static_cast<Acc>(first[2]);
+        acc_3 += static_cast<Acc>(first[3]);
+    }
+    for(; first != last; ++first) { acc_0 += static_cast<Acc>(*first); }
+    return (acc_0 + acc_1) + (acc_2 + acc_3);
+}
+
+template<typename Acc, typename T>
+Acc sum(const T* first, const T* last)
+{
+    return sum_scalar<Acc>(first, last);
+}
+
+#if defined(__AVX2__)
+template<>
+inline std::int64_t sum<std::int64_t, std::int32_t>(const std::int32_t* first, const std::int32_t* last)
+{
+    __m256i acc_0 = _mm256_setzero_si256();
+    __m256i acc_1 = _mm256_setzero_si256();
+    for(; last - first >= 8; first += 8)
+    {
+        acc_0 = _mm256_add_epi64(acc_0, _mm256_cvtepi32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(first))));
+        acc_1 = _mm256_add_epi64(acc_1, _mm256_cvtepi32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(first + 4))));
+    }
+    alignas(32) std::int64_t lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), _mm256_add_epi64(acc_0, acc_1));
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sum_scalar<std::int64_t>(first, last);
+}
+
+template<>
+inline double sum<double, float>(const float* first, const float* last)
+{
+    __m256d acc_0 = _mm256_setzero_pd();
+    __m256d acc_1 = _mm256_setzero_pd();
+    for(; last - first >= 8; first += 8)
+    {
+        acc_0 = _mm256_add_pd(acc_0, _mm256_cvtps_pd(_mm_loadu_ps(first)));
+        acc_1 = _mm256_add_pd(acc_1, _mm256_cvtps_pd(_mm_loadu_ps(first + 4)));
+    }
+    alignas(32) double lanes[4];
+    _mm256_store_pd(lanes, _mm256_add_pd(acc_0, acc_1));
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + sum_scalar<double>(first, last);
+}
+
+template<>
+inline double sum<double, double>(const double* first, const double* last)
+{
+    __m256d acc_0 = _mm256_setzero_pd();
+    __m256d acc_1 = _mm256_setzero_pd();
+    for(; last - first >= 8; first += 8)
+    {
+        acc_0 = _mm256_add_pd(acc_0, _mm256_loadu_pd(first));
+        acc_1 = _mm256_add_pd(acc_1, _mm256_loadu_pd(first + 4));
+    }
+    alignas(32) double lanes[4];
+    _mm256_store_pd(lanes, _mm256_add_pd(acc_0, acc_1));
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + sum_scalar<double>(first, last);
+}
+#elif defined(__SSE2__)
+#if defined(__SSE4_1__)
+template<>
+inline std::int64_t sum<std::int64_t, std::int32_t>(const std::int32_t* first, const std::int32_t* last)
+{
+    __m128i acc_0 = _mm_setzero_si128();
+    __m128i acc_1 = _mm_setzero_si128();
+    for(; last - first >= 4; first += 4)
+    {
+        const __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+        acc_0 = _mm_add_epi64(acc_0, _mm_cvtepi32_epi64(values));
+        acc_1 = _mm_add_epi64(acc_1, _mm_cvtepi32_epi64(_mm_srli_si128(values, 8)));
+    }
+    alignas(16) std::int64_t lanes[2];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes), _mm_add_epi64(acc_0, acc_1));
+    return lanes[0] + lanes[1] + sum_scalar<std::int64_t>(first, last);
+}
+#endif
+
+template<>
+inline double sum<double, float>(const float* first, const float* last)
+{
+    __m128d acc_0 = _mm_setzero_pd();
+    __m128d acc_1 = _mm_setzero_pd();
+    for(; last - first >= 4; first += 4)
+    {
+        const __m128 values = _mm_loadu_ps(first);
+        acc_0 = _mm_add_pd(acc_0, _mm_cvtps_pd(values));
+        acc_1 = _mm_add_pd(acc_1, _mm_cvtps_pd(_mm_movehl_ps(values, values)));
+    }
+    alignas(16) double lanes[2];
+    _mm_store_pd(lanes, _mm_add_pd(acc_0, acc_1));
+    return lanes[0] + lanes[1] + sum_scalar<double>(first, last);
+}
+
+template<>
+inline double sum<double, double>(const double* first, const double* last)
+{
+    __m128d acc_0 = _mm_setzero_pd();
+    __m128d acc_1 = _mm_setzero_pd();
+    for(; last - first >= 4; first += 4)
+    {
+        acc_0 = _mm_add_pd(acc_0, _mm_loadu_pd(first));
+        acc_1 = _mm_add_pd(acc_1, _mm_loadu_pd(first + 2));
+    }
+    alignas(16) double lanes[2];
+    _mm_store_pd(lanes, _mm_add_pd(acc_0, acc_1));
+    return lanes[0] + lanes[1] + sum_scalar<double>(first, last);
+}
+#endif
+
+/// Inclusive (or exclusive) prefix sum of int32 values starting from carry. Returns carry for next element.
+/// Four elements are scanned in register with two shift+add steps, exclusive result is inclusive minus input.
+inline std::int32_t scan_add(const std::int32_t* first, const std::int32_t* last, std::int32_t* out,
+                             std::int32_t carry, const bool exclusive)
+{
+#if defined(__SSE2__)
+    __m128i offset = _mm_set1_epi32(carry);
+    for(; last - first >= 4; first += 4, out += 4)
+    {
+        const __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+        __m128i scanned = _mm_add_epi32(values, _mm_slli_si128(values, 4));
+        scanned = _mm_add_epi32(scanned, _mm_slli_si128(scanned, 8));
+        scanned = _mm_add_epi32(scanned, offset);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), exclusive ? _mm_sub_epi32(scanned, values) : scanned);
+        offset = _mm_shuffle_epi32(scanned, _MM_SHUFFLE(3, 3, 3, 3)); ///< broadcast last sum
+    }
+    carry = _mm_cvtsi128_si32(offset);
+#endif
+    for(; first != last; ++first, ++out)
+    {
+        const std::int32_t value = *first;
+        const std::int32_t sum = static_cast<std::int32_t>(static_cast<std::uint32_t>(carry) + static_cast<std::uint32_t>(value));
+        *out = exclusive ? carry : sum;
+        carry = sum;
+    }
+    return carry;
+}
+} ///< namespace simd
+
 template<typename Iterator,typename T>
 T parallel_accumulate(Iterator first,Iterator last,T init)
 {
@@ -38,9 +219,8 @@ T parallel_accumulate(Iterator first,Iterator last,T init)
     unsigned long const hardware_threads = std::thread::hardware_concurrency();
     unsigned long const num_threads = std::min(hardware_threads != 0 ? hardware_threads:2, max_threads);
     unsigned long const block_size = length / num_threads;
-    std::cout << "Hardware threads: " << hardware_threads << "  Started threads: " << num_threads << std::endl; 
 
-    std::vector<T> results(num_threads);
+    std::vector<padded<T>> results(num_threads); ///< each thread writes to its own cache line
     std::vector<std::thread> threads(num_threads-1);
 
     Iterator block_start=first;
@@ -48,12 +228,13 @@ T parallel_accumulate(Iterator first,Iterator last,T init)
     {
         Iterator block_end=block_start;
         std::advance(block_end,block_size);
-        threads[i] = std::thread(accumulate_block<Iterator,T>(), block_start, block_end, std::ref(results[i]));
+        threads[i] = std::thread(accumulate_block<Iterator,T>(), block_start, block_end, std::ref(results[i].value));
         block_start=block_end;
     }
-    accumulate_block<Iterator,T>()(block_start,last,results[num_threads-1]);
+    accumulate_block<Iterator,T>()(block_start,last,results[num_threads-1].value);
     std::for_each(threads.begin(),threads.end(), std::mem_fn(&std::thread::join));
-    return std::accumulate(results.begin(),results.end(),init);
+    for(const padded<T>& result : results) { init += result.value; }
+    return init;
 }
 
 template<typename Iterator,typename T>
@@ -67,9 +248,8 @@ T parallel_accumulate_async(Iterator first,Iterator last,T init)
     unsigned long const hardware_threads = std::thread::hardware_concurrency();
     unsigned long const num_threads = std::min(hardware_threads != 0 ? hardware_threads:2, max_threads);
     unsigned long const block_size = length / num_threads;
-    std::cout << "Hardware threads: " << hardware_threads << "  Started threads: " << num_threads << std::endl; 
 
-    std::vector<std::future<uint>> futures;
+    std::vector<std::future<T>> futures;
     futures.reserve(num_threads-1);
 
     /// start tasks
@@ -78,7 +258,7 @@ T parallel_accumulate_async(Iterator first,Iterator last,T init)
     {
         Iterator block_end=block_start;
         std::advance(block_end,block_size);
-        futures[i] = std::async(std::launch::async, accumulate_block_for_async<Iterator,T>(), block_start, block_end);
+        futures.push_back(std::async(std::launch::async, accumulate_block_for_async<Iterator,T>(), block_start, block_end));
         block_start=block_end;
     }
     init += accumulate_block_for_async<Iterator,T>()(block_start,last);  ///< start last block 
@@ -86,30 +266,582 @@ T parallel_accumulate_async(Iterator first,Iterator last,T init)
     return init;
 }
 
+/// Fan-out/fan-in without waiting threads - blocks go to pool and partial sums are combined by a continuation
+/// once all of them are ready. Only whoever finally needs the value blocks on the returned future.
+template<typename Iterator,typename T>
+task_future<T> parallel_accumulate_async(Iterator first,Iterator last,T init,thread_pool& pool)
+{
+    unsigned long const length = std::distance(first,last);
+    unsigned long const min_per_task = 25;
+    unsigned long const max_tasks = (length + min_per_task-1) / min_per_task;
+    unsigned long const num_tasks = std::max(1ul, std::min<unsigned long>(pool.size(), max_tasks));
+    unsigned long const block_size = length / num_tasks;
+
+    std::vector<task_future<T>> partials;
+    partials.reserve(num_tasks);
+    Iterator block_start=first;
+    for(unsigned long i = 0; i < num_tasks; ++i)
+    {
+        Iterator block_end=block_start;
+        if(i + 1 == num_tasks){ block_end = last; }
+        else{ std::advance(block_end,block_size); }
+        partials.push_back(pool.submit_task([block_start, block_end]{ return accumulate_block_for_async<Iterator,T>()(block_start, block_end); }));
+        block_start=block_end;
+    }
+    return when_all(std::move(partials)).then(pool, [init](task_future<std::vector<task_future<T>>> all) mutable {
+        for(auto& partial : all.get()){ init += partial.get(); }
+        return init;
+    });
+}
 
-int main()
+/// Reduction over contiguous data with vectorized kernels and accumulator wider than element type.
+/// Every thread keeps its partial sum in its own cache line.
+template<typename T, typename Acc = wide_accumulator_t<T>>
+Acc parallel_accumulate_simd(const T* first, const T* last, Acc init)
 {
+    unsigned long const length = last - first;
+    if(!length){ return init; }
+
+    unsigned long const min_per_thread = 1 << 14; ///< vectorized loop needs big blocks to pay for thread start
+    unsigned long const max_threads = (length + min_per_thread-1) / min_per_thread;
+    unsigned long const hardware_threads = std::thread::hardware_concurrency();
+    unsigned long const num_threads = std::min(hardware_threads != 0 ? hardware_threads:2, max_threads);
+    unsigned long const block_size = length / num_threads;
+
+    std::vector<padded<Acc>> partials(num_threads);
+    std::vector<std::thread> threads(num_threads-1);
+
+    const T* block_start=first;
+    for(unsigned long i = 0; i < (num_threads - 1); ++i)
+    {
+        const T* const block_end=block_start + block_size;
+        threads[i] = std::thread([block_start, block_end, &partial = partials[i].value](){
+            partial = simd::sum<Acc>(block_start, block_end);
+        });
+        block_start=block_end;
+    }
+    partials[num_threads-1].value = simd::sum<Acc>(block_start, last);
+    std::for_each(threads.begin(),threads.end(), std::mem_fn(&std::thread::join));
+    for(const padded<Acc>& partial : partials) { init += partial.value; }
+    return init;
+}
+
+template<typename T, typename Acc = wide_accumulator_t<T>>
+Acc parallel_accumulate_simd(const std::vector<T>& data, Acc init = Acc())
+{
+    return parallel_accumulate_simd<T, Acc>(data.data(), data.data() + data.size(), init);
+}
+
+/// Thread count and block size chosen by accumulate_tuner for one call
+struct accumulate_plan
+{
+    unsigned long length = 0;
+    unsigned long num_threads = 1;
+    unsigned long block_size = 0;
+    bool run_inline = true;     ///< too little work to pay for a thread
+    double estimated_ns = 0.;
+};
+
+std::ostream& operator<<(std::ostream& os, const accumulate_plan& plan)
+{
+    return os << "length=" << plan.length << " threads=" << plan.num_threads << " block_size=" << plan.block_size
+              << " inline=" << plan.run_inline << " estimated=" << plan.estimated_ns << "[ns]";
+}
+
+/// Measures once (per element type) how long it takes to accumulate one element and to start+join one thread.
+/// With t threads call costs about length * element_cost / t + (t - 1) * thread_cost, which is minimal for
+/// t = sqrt(length * element_cost / thread_cost), clamped to [1, hardware threads].
+template<typename T>
+class accumulate_tuner
+{
+private:
+    using clock = std::chrono::steady_clock;
+
+    double element_cost_ns;
+    double thread_cost_ns;
+    unsigned long hardware_threads;
+    T calibration_result; ///< keeps measured loop from being optimized away
+
+    static double elapsed_ns(const clock::time_point begin)
+    {
+        return std::chrono::duration<double, std::nano>(clock::now() - begin).count();
+    }
+
+    accumulate_tuner() : element_cost_ns(0.), thread_cost_ns(0.), hardware_threads(2), calibration_result()
+    {
+        const unsigned long hardware_concurrency = std::thread::hardware_concurrency();
+        this->hardware_threads = hardware_concurrency != 0 ? hardware_concurrency : 2;
+
+        /// best of few runs, first one warms up caches
+        const std::vector<T> sample(1 << 16, T(1));
+        double best_element_ns = std::numeric_limits<double>::max();
+        for(int run = 0; run < 5; ++run)
+        {
+            const clock::time_point begin = clock::now();
+            this->calibration_result += std::accumulate(sample.begin(), sample.end(), T());
+            best_element_ns = std::min(best_element_ns, elapsed_ns(begin) / sample.size());
+        }
+        this->element_cost_ns = best_element_ns;
+
+        constexpr unsigned threads_per_run = 8;
+        double best_thread_ns = std::numeric_limits<double>::max();
+        for(int run = 0; run < 3; ++run)
+        {
+            const clock::time_point begin = clock::now();
+            std::vector<std::thread> threads;
+            for(unsigned i = 0; i < threads_per_run; ++i) { threads.emplace_back([](){}); }
+            std::for_each(threads.begin(),threads.end(), std::mem_fn(&std::thread::join));
+            best_thread_ns = std::min(best_thread_ns, elapsed_ns(begin) / threads_per_run);
+        }
+        this->thread_cost_ns = best_thread_ns;
+    }
+
+public:
+    /// Calibrated on first use, initialization of function local static is thread-safe
+    static accumulate_tuner& instance()
+    {
+        static accumulate_tuner tuner;
+        return tuner;
+    }
+
+    double element_cost() const { return this->element_cost_ns; }
+    double thread_cost() const { return this->thread_cost_ns; }
+
+    accumulate_plan plan(const unsigned long length) const
+    {
+        accumulate_plan result;
+        result.length = length;
+        const double work_ns = length * this->element_cost_ns;
+        const double best_threads = std::sqrt(work_ns / std::max(this->thread_cost_ns, 1.));
+        result.num_threads = std::max(1ul, std::min({static_cast<unsigned long>(best_threads), this->hardware_threads,
+                                                     std::max(length, 1ul)}));
+        result.block_size = length / result.num_threads;
+        result.run_inline = result.num_threads == 1;
+        result.estimated_ns = work_ns / result.num_threads + (result.num_threads - 1) * this->thread_cost_ns;
+        return result;
+    }
+};
+
+/// parallel_accumulate with thread count and block size picked by accumulate_tuner.
+/// Small inputs are summed on calling thread. Chosen plan is stored in chosen_plan if given.
+template<typename Iterator,typename T>
+T parallel_accumulate_auto(Iterator first,Iterator last,T init,accumulate_plan* chosen_plan = nullptr)
+{
+    using value_type = typename std::iterator_traits<Iterator>::value_type;
+    const accumulate_plan plan = accumulate_tuner<value_type>::instance().plan(std::distance(first,last));
+    if(chosen_plan) { *chosen_plan = plan; }
+    if(plan.run_inline) { return std::accumulate(first,last,init); }
+
+    std::vector<padded<T>> results(plan.num_threads);
+    std::vector<std::thread> threads(plan.num_threads-1);
+
+    Iterator block_start=first;
+    for(unsigned long i = 0; i < (plan.num_threads - 1); ++i)
+    {
+        Iterator block_end=block_start;
+        std::advance(block_end,plan.block_size);
+        threads[i] = std::thread(accumulate_block<Iterator,T>(), block_start, block_end, std::ref(results[i].value));
+        block_start=block_end;
+    }
+    accumulate_block<Iterator,T>()(block_start,last,results[plan.num_threads-1].value);
+    std::for_each(threads.begin(),threads.end(), std::mem_fn(&std::thread::join));
+    for(const padded<T>& result : results) { init += result.value; }
+    return init;
+}
+
+/// Same block division as parallel_accumulate, but blocks run on the work-stealing pool instead of fresh threads
+template<typename Iterator,typename T>
+T parallel_accumulate_pool(Iterator first,Iterator last,T init,thread_pool& pool)
+{
+    unsigned long const length = std::distance(first,last);
+    if(!length){ return init; }
+
+    unsigned long const min_per_thread = 25;
+    unsigned long const max_blocks = (length + min_per_thread-1) / min_per_thread;
+    unsigned long const num_blocks = std::min<unsigned long>(pool.size() + 1, max_blocks); ///< workers + caller
+    unsigned long const block_size = length / num_blocks;
+
+    std::vector<std::future<T>> futures(num_blocks-1);
+    Iterator block_start=first;
+    for(unsigned long i = 0; i < (num_blocks - 1); ++i)
+    {
+        Iterator block_end=block_start;
+        std::advance(block_end,block_size);
+        futures[i] = pool.submit([block_start, block_end](){ return std::accumulate(block_start, block_end, T()); });
+        block_start=block_end;
+    }
+    T result = std::accumulate(block_start,last,T()); ///< last block on calling thread
+    for(auto& fut : futures)
+    {
+        pool.wait(fut);
+        result += fut.get();
+    }
+    return init + result;
+}
+
+/// Executors decide where blocks of parallel_reduce run. Each of them provides:
+///     concurrency()  - how many blocks are worth creating
+///     submit(f)      - starts f and returns std::future of its result
+///     get(future)    - waits for result
+/// @{
+
+/// New std::thread for every block, joined when executor is destroyed
+class thread_executor
+{
+private:
+    std::vector<std::thread> threads;
+public:
+    thread_executor() = default;
+    thread_executor(const thread_executor&) = delete;
+    thread_executor& operator=(const thread_executor&) = delete;
+    ~thread_executor() { std::for_each(threads.begin(),threads.end(), std::mem_fn(&std::thread::join)); }
+
+    unsigned concurrency() const
+    {
+        const unsigned hardware_threads = std::thread::hardware_concurrency();
+        return hardware_threads != 0 ? hardware_threads : 2;
+    }
+
+    template<typename Func>
+    std::future<std::invoke_result_t<Func>> submit(Func f)
+    {
+        std::packaged_task<std::invoke_result_t<Func>()> task(std::move(f));
+        std::future<std::invoke_result_t<Func>> res(task.get_future());
+        this->threads.emplace_back(std::move(task));
+        return res;
+    }
+
+    template<typename T>
+    T get(std::future<T>& f) { return f.get(); }
+};
+
+/// Blocks run through std::async
+struct async_executor
+{
+    unsigned concurrency() const
+    {
+        const unsigned hardware_threads = std::thread::hardware_concurrency();
+        return hardware_threads != 0 ? hardware_threads : 2;
+    }
+
+    template<typename Func>
+    std::future<std::invoke_result_t<Func>> submit(Func f) { return std::async(std::launch::async, std::move(f)); }
+
+    template<typename T>
+    T get(std::future<T>& f) { return f.get(); }
+};
+
+/// Blocks run on work-stealing pool, waiting thread executes other tasks in the meantime
+class pool_executor
+{
+private:
+    thread_pool& pool;
+public:
+    explicit pool_executor(thread_pool& pool_ = default_thread_pool()) : pool(pool_) {}
+
+    unsigned concurrency() const { return this->pool.size() + 1; } ///< workers + calling thread
+
+    template<typename Func>
+    std::future<std::invoke_result_t<Func>> submit(Func f) { return this->pool.submit(std::move(f)); }
+
+    template<typename T>
+    T get(std::future<T>& f)
+    {
+        this->pool.wait(f);
+        return f.get();
+    }
+};
+/// @}
+
+constexpr unsigned long default_grain_size = 4096;
+
+/// Reduces transform_op(x) of all elements with reduce_op.
+/// reduce_op has to be associative, but not commutative - blocks are reduced left to right and their results are
+/// combined in the same order, so init ends up as the leftmost operand.
+/// grain_size is the minimal number of elements processed by one block.
+template<typename Iterator, typename T, typename ReduceOp, typename TransformOp, typename Executor>
+T parallel_transform_reduce(Iterator first, Iterator last, T init, ReduceOp reduce_op, TransformOp transform_op,
+                            Executor&& executor, unsigned long grain_size = default_grain_size)
+{
+    unsigned long const length = std::distance(first,last);
+    if(!length){ return init; }
+
+    grain_size = std::max(grain_size, 1ul);
+    unsigned long const max_blocks = (length + grain_size-1) / grain_size;
+    unsigned long const num_blocks = std::min<unsigned long>(executor.concurrency(), max_blocks);
+    unsigned long const block_size = length / num_blocks;
+
+    /// block is never empty, so its first element starts the reduction and no identity value is needed
+    auto reduce_block = [reduce_op, transform_op](Iterator block_first, Iterator block_last){
+        T result = transform_op(*block_first);
+        for(++block_first; block_first != block_last; ++block_first)
+        {
+            result = reduce_op(std::move(result), transform_op(*block_first));
+        }
+        return result;
+    };
+
+    std::vector<std::future<T>> futures;
+    futures.reserve(num_blocks-1);
+    Iterator block_start=first;
+    for(unsigned long i = 0; i < (num_blocks - 1); ++i)
+    {
+        Iterator block_end=block_start;
+        std::advance(block_end,block_size);
+        futures.push_back(executor.submit([reduce_block, block_start, block_end](){
+            return reduce_block(block_start, block_end);
+        }));
+        block_start=block_end;
+    }
+    T last_result = reduce_block(block_start,last); ///< last block on calling thread
+
+    for(std::future<T>& fut : futures) { init = reduce_op(std::move(init), executor.get(fut)); }
+    return reduce_op(std::move(init), std::move(last_result));
+}
+
+template<typename Iterator, typename T, typename ReduceOp, typename TransformOp>
+T parallel_transform_reduce(Iterator first, Iterator last, T init, ReduceOp reduce_op, TransformOp transform_op)
+{
+    return parallel_transform_reduce(first, last, std::move(init), reduce_op, transform_op, pool_executor());
+}
+
+template<typename Iterator, typename T, typename ReduceOp, typename Executor>
+T parallel_reduce(Iterator first, Iterator last, T init, ReduceOp reduce_op,
+                  Executor&& executor, unsigned long grain_size = default_grain_size)
+{
+    using value_type = typename std::iterator_traits<Iterator>::value_type;
+    return parallel_transform_reduce(first, last, std::move(init), reduce_op, [](const value_type& value){ return value; },
+                                     std::forward<Executor>(executor), grain_size);
+}
+
+template<typename Iterator, typename T, typename ReduceOp>
+T parallel_reduce(Iterator first, Iterator last, T init, ReduceOp reduce_op)
+{
+    return parallel_reduce(first, last, std::move(init), reduce_op, pool_executor());
+}
+
+/// Iterator over contiguous int32 storage, eligible for vectorized scan
+template<typename Iterator>
+struct is_contiguous_int32 : std::integral_constant<bool,
+    std::is_same<Iterator, std::int32_t*>::value ||
+    std::is_same<Iterator, const std::int32_t*>::value ||
+    std::is_same<Iterator, std::vector<std::int32_t>::iterator>::value ||
+    std::is_same<Iterator, std::vector<std::int32_t>::const_iterator>::value>
+{};
+
+template<typename BinaryOp>
+struct is_plus : std::integral_constant<bool,
+    std::is_same<BinaryOp, std::plus<>>::value || std::is_same<BinaryOp, std::plus<std::int32_t>>::value>
+{};
+
+/// Reduction of non-empty block
+template<typename T, typename Iterator, typename BinaryOp>
+T reduce_block(Iterator first, Iterator last, BinaryOp op)
+{
+    if constexpr(is_contiguous_int32<Iterator>::value && is_plus<BinaryOp>::value && std::is_same<T, std::int32_t>::value)
+    {
+        const std::int32_t* const data = &*first;
+        return static_cast<std::int32_t>(simd::sum<std::int64_t>(data, data + (last - first))); ///< wraps like int32 sum
+    }
+    else
+    {
+        T result = *first;
+        for(++first; first != last; ++first) { result = op(std::move(result), *first); }
+        return result;
+    }
+}
+
+/// Writes carry op x[0], carry op x[0] op x[1], ... (inclusive) or carry, carry op x[0], ... (exclusive)
+template<bool exclusive, typename T, typename InputIt, typename OutputIt, typename BinaryOp>
+void scan_block(InputIt first, InputIt last, OutputIt out, T carry, BinaryOp op)
+{
+    if constexpr(is_contiguous_int32<InputIt>::value && is_contiguous_int32<OutputIt>::value &&
+                 is_plus<BinaryOp>::value && std::is_same<T, std::int32_t>::value)
+    {
+        if(first == last) { return; }
+        const std::int32_t* const data = &*first;
+        simd::scan_add(data, data + (last - first), &*out, carry, exclusive);
+    }
+    else
+    {
+        for(; first != last; ++first, ++out)
+        {
+            T next = op(carry, *first);
+            *out = exclusive ? std::move(carry) : next;
+            carry = std::move(next);
+        }
+    }
+}
+
+/// Two pass scan with the same block division as parallel_accumulate:
+///     1. every block computes its reduction in parallel
+///     2. block reductions are scanned sequentially into block offsets (only num_blocks elements)
+///     3. every block scans its elements again starting from its offset, in parallel
+/// Inclusive scan has no init, its first block starts from first element.
+template<bool exclusive, typename InputIt, typename OutputIt, typename T, typename BinaryOp, typename Executor>
+OutputIt parallel_scan(InputIt first, InputIt last, OutputIt d_first, T init, BinaryOp op,
+                       Executor&& executor, unsigned long grain_size)
+{
+    unsigned long const length = std::distance(first,last);
+    if(!length){ return d_first; }
+
+    grain_size = std::max(grain_size, 1ul);
+    unsigned long const max_blocks = (length + grain_size-1) / grain_size;
+    unsigned long const num_blocks = std::min<unsigned long>(executor.concurrency(), max_blocks);
+    unsigned long const block_size = length / num_blocks;
+
+    std::vector<InputIt> block_starts(num_blocks + 1, first);
+    for(unsigned long i = 1; i < num_blocks; ++i) { block_starts[i] = std::next(block_starts[i-1], block_size); }
+    block_starts[num_blocks] = last;
+
+    /// pass 1 - reduce every block except the last one, its sum is never needed
+    std::vector<std::future<T>> sums;
+    sums.reserve(num_blocks);
+    for(unsigned long i = 0; i + 1 < num_blocks; ++i)
+    {
+        sums.push_back(executor.submit([block_first = block_starts[i], block_last = block_starts[i+1], op](){
+            return reduce_block<T>(block_first, block_last, op);
+        }));
+    }
+
+    /// pass 2 - offsets of blocks
+    std::vector<T> offsets(num_blocks, init);
+    for(unsigned long i = 1; i < num_blocks; ++i)
+    {
+        T block_sum = executor.get(sums[i-1]);
+        if(exclusive || i > 1) { offsets[i] = op(offsets[i-1], std::move(block_sum)); }
+        else { offsets[i] = std::move(block_sum); } ///< inclusive scan has no init before first block
+    }
+
+    /// pass 3 - scan every block from its offset
+    std::vector<std::future<void>> scans;
+    scans.reserve(num_blocks - 1);
+    for(unsigned long i = 1; i < num_blocks; ++i)
+    {
+        scans.push_back(executor.submit([block_first = block_starts[i], block_last = block_starts[i+1],
+                                         out = std::next(d_first, block_starts[i] - first), carry = offsets[i], op](){
+            scan_block<exclusive>(block_first, block_last, out, carry, op);
+        }));
+    }
+    if(exclusive) { scan_block<exclusive>(block_starts[0], block_starts[1], d_first, init, op); }
+    else
+    {
+        /// first element of inclusive scan is copied as is
+        *d_first = *first;
+        scan_block<exclusive>(std::next(first), block_starts[1], std::next(d_first), T(*first), op);
+    }
+    for(std::future<void>& scan : scans) { executor.get(scan); }
+    return std::next(d_first, length);
+}
+
+template<typename InputIt, typename OutputIt, typename BinaryOp, typename Executor>
+OutputIt parallel_inclusive_scan(InputIt first, InputIt last, OutputIt d_first, BinaryOp op,
+                                 Executor&& executor, unsigned long grain_size = default_grain_size)
+{
+    using value_type = typename std::iterator_traits<InputIt>::value_type;
+    return parallel_scan<false>(first, last, d_first, value_type(), op, std::forward<Executor>(executor), grain_size);
+}
+
+template<typename InputIt, typename OutputIt>
+OutputIt parallel_inclusive_scan(InputIt first, InputIt last, OutputIt d_first)
+{
+    return parallel_inclusive_scan(first, last, d_first, std::plus<>(), pool_executor());
+}
+
+template<typename InputIt, typename OutputIt, typename T, typename BinaryOp, typename Executor>
+OutputIt parallel_exclusive_scan(InputIt first, InputIt last, OutputIt d_first, T init, BinaryOp op,
+                                 Executor&& executor, unsigned long grain_size = default_grain_size)
+{
+    return parallel_scan<true>(first, last, d_first, std::move(init), op, std::forward<Executor>(executor), grain_size);
+}
+
+template<typename InputIt, typename OutputIt, typename T>
+OutputIt parallel_exclusive_scan(InputIt first, InputIt last, OutputIt d_first, T init)
+{
+    return parallel_exclusive_scan(first, last, d_first, std::move(init), std::plus<>(), pool_executor());
+}
+
+int main(int argc, char** argv)
+{
+    bench::harness harness("parallel_sum", argc, argv);
     const uint number_of_points = 100'000'000; 
-    std::vector<int> vi;
-    vi.reserve(number_of_points);;
-    for(int i=0; i < number_of_points;++i) { vi.emplace_back(3); }
+    std::vector<int> vi(number_of_points, 3);
+    const double items = vi.size();
 
     /// with thread objects
-    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
-    int sum_parallel = parallel_accumulate(vi.begin(),vi.end(), 0);
-    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
-    std::cout << "sum_parallel = " << sum_parallel << "  time=" <<  std::chrono::duration_cast<std::chrono::milliseconds> (end - begin).count() << "[ns]" << std::endl;
+    int sum_parallel = 0;
+    harness.run("parallel_accumulate", [&]{ sum_parallel = parallel_accumulate(vi.begin(),vi.end(), 0); }, items);
+    std::cout << "sum_parallel = " << sum_parallel << std::endl;
 
     /// with asyncs and futures
-    begin = std::chrono::steady_clock::now();
-    int sum_parallel_async = parallel_accumulate(vi.begin(),vi.end(), 0);
-    end = std::chrono::steady_clock::now();
-    std::cout << "sum_parallel_async = " << sum_parallel_async << "  time=" <<  std::chrono::duration_cast<std::chrono::milliseconds> (end - begin).count() << "[ns]" << std::endl;
+    int sum_parallel_async = 0;
+    harness.run("parallel_accumulate_async", [&]{ sum_parallel_async = parallel_accumulate_async(vi.begin(),vi.end(), 0); }, items);
+    std::cout << "sum_parallel_async = " << sum_parallel_async << std::endl;
+
+    /// with pool tasks combined by continuation
+    int sum_parallel_then = 0;
+    harness.run("parallel_accumulate_async(pool)", [&]{
+        task_future<int> sum_future = parallel_accumulate_async(vi.begin(),vi.end(), 0, default_thread_pool());
+        default_thread_pool().wait(sum_future); ///< runs pool tasks meanwhile
+        sum_parallel_then = sum_future.get();
+    }, items);
+    std::cout << "sum_parallel_then = " << sum_parallel_then << std::endl;
+
+    /// with thread count tuned to input size
+    const accumulate_tuner<int>& tuner = accumulate_tuner<int>::instance();
+    std::cout << "Calibration: element=" << tuner.element_cost() << "[ns] thread=" << tuner.thread_cost() << "[ns]" << std::endl;
+    for(const unsigned long length : {100ul, 10'000ul, 1'000'000ul}) { std::cout << "  plan " << tuner.plan(length) << std::endl; }
+    accumulate_plan plan;
+    int sum_parallel_auto = 0;
+    harness.run("parallel_accumulate_auto", [&]{ sum_parallel_auto = parallel_accumulate_auto(vi.begin(),vi.end(), 0, &plan); }, items);
+    std::cout << "sum_parallel_auto = " << sum_parallel_auto << "  plan " << plan << std::endl;
+
+    /// with work-stealing pool
+    int sum_parallel_pool = 0;
+    harness.run("parallel_accumulate_pool", [&]{ sum_parallel_pool = parallel_accumulate_pool(vi.begin(),vi.end(), 0, default_thread_pool()); }, items);
+    std::cout << "sum_parallel_pool = " << sum_parallel_pool << std::endl;
+
+    /// with vectorized kernels, result in 64 bit accumulator
+    std::int64_t sum_parallel_simd = 0;
+    harness.run("parallel_accumulate_simd", [&]{ sum_parallel_simd = parallel_accumulate_simd(vi); }, items);
+    std::cout << "sum_parallel_simd = " << sum_parallel_simd << std::endl;
+
+    /// generic reduction with different executors
+    long long sum_reduce_threads = 0;
+    harness.run("parallel_reduce(thread_executor)", [&]{ sum_reduce_threads = parallel_reduce(vi.begin(), vi.end(), 0LL, std::plus<>(), thread_executor()); }, items);
+    std::cout << "sum_reduce_threads = " << sum_reduce_threads << std::endl;
+
+    long long sum_reduce_async = 0;
+    harness.run("parallel_reduce(async_executor)", [&]{ sum_reduce_async = parallel_reduce(vi.begin(), vi.end(), 0LL, std::plus<>(), async_executor()); }, items);
+    std::cout << "sum_reduce_async = " << sum_reduce_async << std::endl;
+
+    long long sum_of_squares = 0;
+    harness.run("parallel_transform_reduce", [&]{
+        sum_of_squares = parallel_transform_reduce(vi.begin(), vi.end(), 0LL, std::plus<>(),
+                                                   [](int x){ return static_cast<long long>(x) * x; });
+    }, items);
+    std::cout << "sum_of_squares = " << sum_of_squares << std::endl;
+
+    /// string concatenation is associative but not commutative
+    std::vector<std::string> words(10000);
+    for(std::size_t i = 0; i < words.size(); ++i) { words[i] = std::to_string(i % 10); }
+    const std::string concatenated = parallel_reduce(words.begin(), words.end(), std::string(), std::plus<>(),
+                                                     pool_executor(), 64);
+    std::cout << "concatenation in order = " << (concatenated == std::accumulate(words.begin(), words.end(), std::string())) << std::endl;
+
+    /// prefix sums
+    std::vector<int> prefix(vi.size());
+    harness.run("parallel_inclusive_scan", [&]{ parallel_inclusive_scan(vi.begin(), vi.end(), prefix.begin()); }, items);
+    std::cout << "parallel_inclusive_scan last = " << prefix.back() << std::endl;
+
+    harness.run("parallel_exclusive_scan", [&]{ parallel_exclusive_scan(vi.begin(), vi.end(), prefix.begin(), 0); }, items);
+    std::cout << "parallel_exclusive_scan last = " << prefix.back() << std::endl;
+
+    harness.run("sequential partial_sum", [&]{ std::partial_sum(vi.begin(), vi.end(), prefix.begin()); }, items);
+    std::cout << "sequential partial_sum last = " << prefix.back() << std::endl;
 
     /// Single threaded
     int sum = 0;
-    begin = std::chrono::steady_clock::now();
-    sum = std::accumulate(vi.begin(),vi.end(), sum);
-    end = std::chrono::steady_clock::now();
-    std::cout << "sum_single_threaded = " << sum << "  time=" <<  std::chrono::duration_cast<std::chrono::milliseconds> (end - begin).count() << "[ns]" << std::endl;
+    harness.run("sequential accumulate", [&]{ sum = std::accumulate(vi.begin(),vi.end(), 0); }, items);
+    std::cout << "sum_single_threaded = " << sum << std::endl;
 }
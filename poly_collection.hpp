@@ -0,0 +1,115 @@
+#pragma once
+/**
+ *  Containers for polymorphic objects without pointer chasing.
+ *
+ *  std::vector<std::unique_ptr<Base>> keeps every object in its own heap allocation, so iteration misses cache on
+ *  every element and the virtual call target changes randomly, which the branch predictor cant follow.
+ *
+ *  - poly_collection<Base, Derived...>: every concrete type lives in its own contiguous vector (segment).
+ *    for_each walks segment after segment and calls f with the concrete type, so calls on final classes (or
+ *    qualified calls) are resolved at compile time and can be inlined. Objects of different types dont keep their
+ *    insertion order, and like in std::vector references are invalidated when their segment grows.
+ *  - variant_collection<Ts...>: closed set of types without common base. One vector of std::variant keeps insertion
+ *    order, dispatch is std::visit (jump table). Every element takes the size of the largest alternative.
+ */
+
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+template<typename Base, typename... Derived>
+class poly_collection
+{
+private:
+    static_assert((std::is_base_of_v<Base, Derived> && ...), "every segment type has to derive from Base");
+
+    std::tuple<std::vector<Derived>...> segments;
+
+    template<typename T, typename Func>
+    static void for_each_in(std::vector<T>& items, Func& f)
+    {
+        for(T& item : items) { f(item); }
+    }
+
+    template<typename T, typename Func>
+    static void for_each_in(const std::vector<T>& items, Func& f)
+    {
+        for(const T& item : items) { f(item); }
+    }
+
+public:
+    template<typename T>
+    std::vector<T>& segment() { return std::get<std::vector<T>>(this->segments); }
+
+    template<typename T>
+    const std::vector<T>& segment() const { return std::get<std::vector<T>>(this->segments); }
+
+    template<typename T, typename... Args>
+    T& emplace(Args&&... args)
+    {
+        return this->segment<T>().emplace_back(std::forward<Args>(args)...);
+    }
+
+    template<typename T>
+    T& insert(T value)
+    {
+        std::vector<T>& items = this->segment<T>();
+        items.push_back(std::move(value));
+        return items.back();
+    }
+
+    template<typename T>
+    void reserve(const std::size_t count) { this->segment<T>().reserve(count); }
+
+    std::size_t size() const { return (this->segment<Derived>().size() + ... + 0); }
+    bool empty() const { return this->size() == 0; }
+    void clear() { (this->segment<Derived>().clear(), ...); }
+
+    /// f is called with Derived& (generic lambda) or Base& - segments in order of Derived...
+    template<typename Func>
+    void for_each(Func f)
+    {
+        (for_each_in(this->segment<Derived>(), f), ...);
+    }
+
+    template<typename Func>
+    void for_each(Func f) const
+    {
+        (for_each_in(this->segment<Derived>(), f), ...);
+    }
+};
+
+template<typename... Ts>
+class variant_collection
+{
+private:
+    std::vector<std::variant<Ts...>> items;
+
+public:
+    template<typename T, typename... Args>
+    T& emplace(Args&&... args)
+    {
+        return std::get<T>(this->items.emplace_back(std::in_place_type<T>, std::forward<Args>(args)...));
+    }
+
+    void reserve(const std::size_t count) { this->items.reserve(count); }
+    std::size_t size() const { return this->items.size(); }
+    bool empty() const { return this->items.empty(); }
+    void clear() { this->items.clear(); }
+
+    /// f has to accept every alternative, elements are visited in insertion order
+    template<typename Func>
+    void for_each(Func f)
+    {
+        for(std::variant<Ts...>& item : this->items) { std::visit(f, item); }
+    }
+
+    template<typename Func>
+    void for_each(Func f) const
+    {
+        for(const std::variant<Ts...>& item : this->items) { std::visit(f, item); }
+    }
+};
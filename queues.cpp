@@ -4,6 +4,17 @@
 #include <memory>
 #include <thread>
 #include <iostream>
+#include <atomic>
+#include <vector>
+#include <chrono>
+#include <new>
+#include <string>
+#include <algorithm>
+#include <array>
+
+#include "hazard_pointer.hpp"
+#include "benchmark.hpp"
+#include "cache_line.hpp"
 
 /// queue holding data
 namespace v1
@@ -190,6 +201,613 @@ public:
 };
 } ///< namespace v3
 
+/// queues that scale with number of threads
+namespace v4
+{
+
+/// Linked list queue with separate locks for head and tail.
+/// Dummy node at the end of the list ensures that push() touches only tail and pop touches only head,
+/// so producers and consumers dont wait for each other.
+template<typename T>
+class threadsafe_queue
+{
+private:
+    struct node
+    {
+        std::shared_ptr<T> data;
+        std::unique_ptr<node> next;
+    };
+
+    std::mutex head_mutex;
+    std::unique_ptr<node> head;
+    std::mutex tail_mutex;
+    node* tail;
+    std::condition_variable data_cond;
+
+    node* get_tail()
+    {
+        std::lock_guard<std::mutex> tail_lock(tail_mutex);
+        return this->tail;
+    }
+
+    std::unique_ptr<node> pop_head()
+    {
+        std::unique_ptr<node> old_head = std::move(this->head);
+        this->head = std::move(old_head->next);
+        return old_head;
+    }
+
+    std::unique_lock<std::mutex> wait_for_data()
+    {
+        std::unique_lock<std::mutex> head_lock(head_mutex);
+        data_cond.wait(head_lock, [&]{ return this->head.get() != get_tail(); });
+        return head_lock;
+    }
+
+    std::unique_ptr<node> wait_pop_head()
+    {
+        std::unique_lock<std::mutex> head_lock(wait_for_data());
+        return pop_head();
+    }
+
+    std::unique_ptr<node> wait_pop_head(T& value)
+    {
+        std::unique_lock<std::mutex> head_lock(wait_for_data());
+        value = std::move(*this->head->data);
+        return pop_head();
+    }
+
+    std::unique_ptr<node> try_pop_head()
+    {
+        std::lock_guard<std::mutex> head_lock(head_mutex);
+        if(this->head.get() == get_tail()) { return std::unique_ptr<node>(); }
+        return pop_head();
+    }
+
+    std::unique_ptr<node> try_pop_head(T& value)
+    {
+        std::lock_guard<std::mutex> head_lock(head_mutex);
+        if(this->head.get() == get_tail()) { return std::unique_ptr<node>(); }
+        value = std::move(*this->head->data);
+        return pop_head();
+    }
+
+public:
+    threadsafe_queue() : head(new node), tail(head.get()) {}
+    threadsafe_queue(const threadsafe_queue&) = delete;
+    threadsafe_queue& operator=(const threadsafe_queue&) = delete;
+
+    void push(T new_value)
+    {
+        /// allocate outside of the lock
+        std::shared_ptr<T> new_data(std::make_shared<T>(std::move(new_value)));
+        std::unique_ptr<node> p(new node);
+        {
+            std::lock_guard<std::mutex> tail_lock(tail_mutex);
+            this->tail->data = new_data;
+            node* const new_tail = p.get();
+            this->tail->next = std::move(p);
+            this->tail = new_tail;
+        }
+        data_cond.notify_one();
+    }
+
+    std::shared_ptr<T> wait_and_pop()
+    {
+        const std::unique_ptr<node> old_head = wait_pop_head();
+        return old_head->data;
+    }
+
+    void wait_and_pop(T& value)
+    {
+        const std::unique_ptr<node> old_head = wait_pop_head(value);
+    }
+
+    std::shared_ptr<T> try_pop()
+    {
+        const std::unique_ptr<node> old_head = try_pop_head();
+        return old_head ? old_head->data : std::shared_ptr<T>();
+    }
+
+    bool try_pop(T& value)
+    {
+        const std::unique_ptr<node> old_head = try_pop_head(value);
+        return static_cast<bool>(old_head);
+    }
+
+    bool empty()
+    {
+        std::lock_guard<std::mutex> head_lock(head_mutex);
+        return this->head.get() == get_tail();
+    }
+};
+
+/// Lock-free Michael-Scott queue.
+/// Same head/tail/dummy node layout as threadsafe_queue but links are updated with compare_exchange.
+/// Popped nodes are reclaimed with hazard pointers, because other threads may still read them.
+template<typename T>
+class lock_free_queue
+{
+private:
+    struct node
+    {
+        std::atomic<node*> next;
+        alignas(T) unsigned char storage[sizeof(T)]; ///< value lives inline, one allocation per push
+
+        node() : next(nullptr) {}
+        explicit node(T&& value) : next(nullptr) { new (storage) T(std::move(value)); }
+        T* value() { return std::launder(reinterpret_cast<T*>(storage)); }
+    };
+
+    std::atomic<node*> head;
+    std::atomic<node*> tail;
+
+    /// wait_and_pop() sleeps on condition variable. push() notifies only if somebody waits.
+    std::atomic<unsigned> waiters;
+    std::mutex wait_mutex;
+    std::condition_variable data_cond;
+
+    /// Removes first element and passes it to sink. Returns false if queue is empty.
+    template<typename Sink>
+    bool pop_into(Sink&& sink)
+    {
+        std::atomic<void*>& hp_head = hazard::get_hazard_pointer_for_current_thread(0);
+        std::atomic<void*>& hp_next = hazard::get_hazard_pointer_for_current_thread(1);
+        while(true)
+        {
+            node* old_head = hazard::protect(hp_head, this->head);
+            node* old_tail = this->tail.load();
+            node* const next = old_head->next.load();
+            hp_next.store(next);
+            if(old_head != this->head.load()) { continue; } ///< next might be already retired
+
+            if(next == nullptr)
+            {
+                hp_head.store(nullptr);
+                hp_next.store(nullptr);
+                return false;
+            }
+            if(old_head == old_tail)
+            {
+                this->tail.compare_exchange_strong(old_tail, next); ///< help lagging push()
+                continue;
+            }
+            if(this->head.compare_exchange_strong(old_head, next))
+            {
+                /// next becomes new dummy node. Only this thread owns its value now.
+                T* const value = next->value();
+                sink(std::move(*value));
+                value->~T();
+
+                hp_head.store(nullptr);
+                hp_next.store(nullptr);
+                hazard::retire(old_head);
+                return true;
+            }
+        }
+    }
+
+    void notify_waiters()
+    {
+        if(this->waiters.load() == 0) { return; }
+        std::lock_guard<std::mutex> lock(wait_mutex);
+        data_cond.notify_one();
+    }
+
+    template<typename Sink>
+    void wait_and_pop_into(Sink&& sink)
+    {
+        while(not pop_into(sink))
+        {
+            std::unique_lock<std::mutex> lock(wait_mutex);
+            ++this->waiters;
+            data_cond.wait(lock, [this]{ return not empty(); });
+            --this->waiters;
+        }
+    }
+
+public:
+    lock_free_queue() : head(new node), tail(head.load()), waiters(0) {}
+    lock_free_queue(const lock_free_queue&) = delete;
+    lock_free_queue& operator=(const lock_free_queue&) = delete;
+    ~lock_free_queue()
+    {
+        while(pop_into([](T&&){})) {}
+        delete this->head.load();
+    }
+
+    void push(T new_value)
+    {
+        node* const new_node = new node(std::move(new_value));
+        std::atomic<void*>& hp_tail = hazard::get_hazard_pointer_for_current_thread(0);
+        while(true)
+        {
+            node* old_tail = hazard::protect(hp_tail, this->tail);
+            node* next = old_tail->next.load();
+            if(old_tail != this->tail.load()) { continue; }
+
+            if(next != nullptr)
+            {
+                this->tail.compare_exchange_weak(old_tail, next); ///< tail is lagging, move it forward
+                continue;
+            }
+            if(old_tail->next.compare_exchange_weak(next, new_node))
+            {
+                this->tail.compare_exchange_strong(old_tail, new_node);
+                break;
+            }
+        }
+        hp_tail.store(nullptr);
+        notify_waiters();
+    }
+
+    bool try_pop(T& value)
+    {
+        return pop_into([&value](T&& popped){ value = std::move(popped); });
+    }
+
+    std::shared_ptr<T> try_pop()
+    {
+        std::shared_ptr<T> res;
+        pop_into([&res](T&& popped){ res = std::make_shared<T>(std::move(popped)); });
+        return res;
+    }
+
+    void wait_and_pop(T& value)
+    {
+        wait_and_pop_into([&value](T&& popped){ value = std::move(popped); });
+    }
+
+    std::shared_ptr<T> wait_and_pop()
+    {
+        std::shared_ptr<T> res;
+        wait_and_pop_into([&res](T&& popped){ res = std::make_shared<T>(std::move(popped)); });
+        return res;
+    }
+
+    bool empty()
+    {
+        std::atomic<void*>& hp_head = hazard::get_hazard_pointer_for_current_thread(0);
+        const node* const old_head = hazard::protect(hp_head, this->head);
+        const bool is_empty = old_head->next.load() == nullptr;
+        hp_head.store(nullptr);
+        return is_empty;
+    }
+};
+} ///< namespace v4
+
+/// bounded queues on preallocated ring buffers - no allocation per push
+namespace v5
+{
+
+/// Parks threads until predicate holds. notify_all() does not touch mutex when nobody waits.
+class event_waiter
+{
+private:
+    std::atomic<unsigned> waiters;
+    std::mutex m;
+    std::condition_variable cond;
+public:
+    event_waiter() : waiters(0) {}
+
+    template<typename Predicate>
+    void wait(Predicate pred)
+    {
+        std::unique_lock<std::mutex> lock(m);
+        ++this->waiters;
+        std::atomic_thread_fence(std::memory_order_seq_cst); ///< pairs with fence in notify_all()
+        cond.wait(lock, pred);
+        --this->waiters;
+    }
+
+    void notify_all()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(this->waiters.load(std::memory_order_relaxed) == 0) { return; }
+        std::lock_guard<std::mutex> lock(m);
+        cond.notify_all();
+    }
+};
+
+inline std::size_t round_up_to_power_of_two(std::size_t value)
+{
+    std::size_t result = 1;
+    while(result < value) { result <<= 1; }
+    return result;
+}
+
+/// Single producer, single consumer ring buffer.
+/// Each side owns one index and keeps cached copy of the other one, so shared cache lines are touched only when
+/// cached value says that queue is full/empty.
+template<typename T>
+class spsc_queue
+{
+private:
+    struct slot
+    {
+        alignas(T) unsigned char storage[sizeof(T)];
+        T* value() { return std::launder(reinterpret_cast<T*>(storage)); }
+    };
+
+    struct producer_state
+    {
+        std::atomic<std::size_t> tail{0};
+        std::size_t cached_head = 0;
+    };
+    struct consumer_state
+    {
+        std::atomic<std::size_t> head{0};
+        std::size_t cached_tail = 0;
+    };
+
+    const std::size_t capacity;
+    const std::size_t mask;
+    const std::unique_ptr<slot[]> slots;
+    padded<producer_state> producer;
+    padded<consumer_state> consumer;
+    event_waiter not_empty;
+    event_waiter not_full;
+
+    /// number of free slots seen by producer, refreshes cached head only if needed
+    std::size_t free_slots(const std::size_t wanted)
+    {
+        const std::size_t tail = this->producer->tail.load(std::memory_order_relaxed);
+        std::size_t free = this->capacity - (tail - this->producer->cached_head);
+        if(free < wanted)
+        {
+            this->producer->cached_head = this->consumer->head.load(std::memory_order_acquire);
+            free = this->capacity - (tail - this->producer->cached_head);
+        }
+        return free;
+    }
+
+    /// number of elements seen by consumer, refreshes cached tail only if needed
+    std::size_t ready_slots(const std::size_t wanted)
+    {
+        const std::size_t head = this->consumer->head.load(std::memory_order_relaxed);
+        std::size_t ready = this->consumer->cached_tail - head;
+        if(ready < wanted)
+        {
+            this->consumer->cached_tail = this->producer->tail.load(std::memory_order_acquire);
+            ready = this->consumer->cached_tail - head;
+        }
+        return ready;
+    }
+
+public:
+    explicit spsc_queue(const std::size_t capacity_ = 1024) :
+        capacity(round_up_to_power_of_two(capacity_)),
+        mask(capacity - 1),
+        slots(new slot[capacity])
+    {}
+    spsc_queue(const spsc_queue&) = delete;
+    spsc_queue& operator=(const spsc_queue&) = delete;
+    ~spsc_queue()
+    {
+        const std::size_t tail = this->producer->tail.load();
+        for(std::size_t head = this->consumer->head.load(); head != tail; ++head)
+        {
+            this->slots[head & this->mask].value()->~T();
+        }
+    }
+
+    bool try_push(T new_value)
+    {
+        return try_push_n(&new_value, 1) == 1;
+    }
+
+    /// Moves up to count values from first. Returns number of pushed values.
+    template<typename Iterator>
+    std::size_t try_push_n(Iterator first, const std::size_t count)
+    {
+        const std::size_t n = std::min(count, free_slots(count));
+        if(n == 0) { return 0; }
+        const std::size_t tail = this->producer->tail.load(std::memory_order_relaxed);
+        for(std::size_t i = 0; i < n; ++i, ++first)
+        {
+            new (this->slots[(tail + i) & this->mask].storage) T(std::move(*first));
+        }
+        this->producer->tail.store(tail + n, std::memory_order_release); ///< publish whole batch at once
+        this->not_empty.notify_all();
+        return n;
+    }
+
+    bool try_pop(T& value)
+    {
+        return try_pop_n(&value, 1) == 1;
+    }
+
+    /// Moves up to max_count values to out. Returns number of popped values.
+    template<typename OutputIterator>
+    std::size_t try_pop_n(OutputIterator out, const std::size_t max_count)
+    {
+        const std::size_t n = std::min(max_count, ready_slots(max_count));
+        if(n == 0) { return 0; }
+        const std::size_t head = this->consumer->head.load(std::memory_order_relaxed);
+        for(std::size_t i = 0; i < n; ++i, ++out)
+        {
+            T* const value = this->slots[(head + i) & this->mask].value();
+            *out = std::move(*value);
+            value->~T();
+        }
+        this->consumer->head.store(head + n, std::memory_order_release);
+        this->not_full.notify_all();
+        return n;
+    }
+
+    /// Blocks while queue is full - backpressure for producer
+    void push(T new_value)
+    {
+        while(not try_push_n(&new_value, 1))
+        {
+            this->not_full.wait([this]{ return free_slots(1) != 0; });
+        }
+    }
+
+    void wait_and_pop(T& value)
+    {
+        while(not try_pop(value))
+        {
+            this->not_empty.wait([this]{ return ready_slots(1) != 0; });
+        }
+    }
+
+    bool empty() const
+    {
+        return this->consumer->head.load(std::memory_order_acquire) ==
+               this->producer->tail.load(std::memory_order_acquire);
+    }
+};
+
+/// Multi producer, multi consumer ring buffer (D. Vyukov design).
+/// Every cell holds sequence number which tells if it is free for position pos (sequence == pos) or holds value
+/// pushed at position pos (sequence == pos + 1). Threads claim positions with single compare_exchange.
+template<typename T>
+class mpmc_queue
+{
+private:
+    struct cell
+    {
+        std::atomic<std::size_t> sequence;
+        alignas(T) unsigned char storage[sizeof(T)];
+        T* value() { return std::launder(reinterpret_cast<T*>(storage)); }
+    };
+
+    const std::size_t capacity;
+    const std::size_t mask;
+    const std::unique_ptr<cell[]> cells;
+    padded<std::atomic<std::size_t>> enqueue_pos;
+    padded<std::atomic<std::size_t>> dequeue_pos;
+    event_waiter not_empty;
+    event_waiter not_full;
+
+    /// counts consecutive cells starting at pos whose sequence equals pos + offset
+    std::size_t count_cells(const std::size_t pos, const std::size_t offset, const std::size_t max_count)
+    {
+        std::size_t n = 0;
+        while(n < max_count &&
+              this->cells[(pos + n) & this->mask].sequence.load(std::memory_order_acquire) == pos + n + offset)
+        {
+            ++n;
+        }
+        return n;
+    }
+
+    /// Claims up to max_count cells. Returns first claimed position and number of claimed cells.
+    std::pair<std::size_t, std::size_t> claim(std::atomic<std::size_t>& position, const std::size_t offset,
+                                              const std::size_t max_count)
+    {
+        std::size_t pos = position.load(std::memory_order_relaxed);
+        while(true)
+        {
+            const std::size_t n = count_cells(pos, offset, max_count);
+            if(n == 0)
+            {
+                const std::size_t current = position.load(std::memory_order_relaxed);
+                if(current == pos) { return {pos, 0}; } ///< full for push, empty for pop
+                pos = current;
+                continue;
+            }
+            if(position.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed)) { return {pos, n}; }
+        }
+    }
+
+public:
+    explicit mpmc_queue(const std::size_t capacity_ = 1024) :
+        capacity(round_up_to_power_of_two(std::max<std::size_t>(capacity_, 2))),
+        mask(capacity - 1),
+        cells(new cell[capacity]),
+        enqueue_pos(0),
+        dequeue_pos(0)
+    {
+        for(std::size_t i = 0; i < this->capacity; ++i)
+        {
+            this->cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+    mpmc_queue(const mpmc_queue&) = delete;
+    mpmc_queue& operator=(const mpmc_queue&) = delete;
+    ~mpmc_queue()
+    {
+        const std::size_t tail = this->enqueue_pos->load();
+        for(std::size_t head = this->dequeue_pos->load(); head != tail; ++head)
+        {
+            this->cells[head & this->mask].value()->~T();
+        }
+    }
+
+    bool try_push(T new_value)
+    {
+        return try_push_n(&new_value, 1) == 1;
+    }
+
+    /// Moves up to count values from first. Whole batch is claimed with one compare_exchange.
+    template<typename Iterator>
+    std::size_t try_push_n(Iterator first, const std::size_t count)
+    {
+        const std::pair<std::size_t, std::size_t> claimed = claim(*this->enqueue_pos, 0, count);
+        for(std::size_t i = 0; i < claimed.second; ++i, ++first)
+        {
+            cell& c = this->cells[(claimed.first + i) & this->mask];
+            new (c.storage) T(std::move(*first));
+            c.sequence.store(claimed.first + i + 1, std::memory_order_release);
+        }
+        if(claimed.second) { this->not_empty.notify_all(); }
+        return claimed.second;
+    }
+
+    bool try_pop(T& value)
+    {
+        return try_pop_n(&value, 1) == 1;
+    }
+
+    /// Moves up to max_count values to out. Whole batch is claimed with one compare_exchange.
+    template<typename OutputIterator>
+    std::size_t try_pop_n(OutputIterator out, const std::size_t max_count)
+    {
+        const std::pair<std::size_t, std::size_t> claimed = claim(*this->dequeue_pos, 1, max_count);
+        for(std::size_t i = 0; i < claimed.second; ++i, ++out)
+        {
+            cell& c = this->cells[(claimed.first + i) & this->mask];
+            *out = std::move(*c.value());
+            c.value()->~T();
+            c.sequence.store(claimed.first + i + this->capacity, std::memory_order_release); ///< free for next lap
+        }
+        if(claimed.second) { this->not_full.notify_all(); }
+        return claimed.second;
+    }
+
+    /// Blocks while queue is full - backpressure for producers
+    void push(T new_value)
+    {
+        while(not try_push_n(&new_value, 1))
+        {
+            this->not_full.wait([this]{ return not full(); });
+        }
+    }
+
+    void wait_and_pop(T& value)
+    {
+        while(not try_pop(value))
+        {
+            this->not_empty.wait([this]{ return not empty(); });
+        }
+    }
+
+    bool empty()
+    {
+        const std::size_t pos = this->dequeue_pos->load(std::memory_order_acquire);
+        return this->cells[pos & this->mask].sequence.load(std::memory_order_acquire) != pos + 1;
+    }
+
+    bool full()
+    {
+        const std::size_t pos = this->enqueue_pos->load(std::memory_order_acquire);
+        return this->cells[pos & this->mask].sequence.load(std::memory_order_acquire) != pos;
+    }
+};
+} ///< namespace v5
+
 struct data_chunk{};
 data_chunk prepare_data() { return data_chunk(); }
 void prepare_data_thread(v1::threadsafe_queue<data_chunk>& rq)
@@ -198,7 +816,7 @@ void prepare_data_thread(v1::threadsafe_queue<data_chunk>& rq)
     {
         const data_chunk data = prepare_data();
         rq.push(data);
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+        bench::cpu_work_for(std::chrono::milliseconds(1)); ///< rest of the producer work
     }
 }
 
@@ -211,8 +829,94 @@ void data_procesing_thread(v1::threadsafe_queue<data_chunk>& rq)
     }
 }
 
-int main()
+/// Each producer pushes items_per_producer values, consumers pop until all of them are received
+template<typename Queue>
+void producers_consumers_test(bench::harness& harness, const std::string& name, const unsigned producers,
+                              const unsigned consumers, const unsigned items_per_producer)
+{
+    const unsigned long total_items = static_cast<unsigned long>(producers) * items_per_producer;
+    const unsigned long expected_sum = static_cast<unsigned long>(producers) * items_per_producer * (items_per_producer + 1) / 2;
+    bool sum_ok = true;
+    const std::string label = name + " producers=" + std::to_string(producers) + " consumers=" + std::to_string(consumers);
+    harness.run(label, [&]{
+        Queue queue;
+        std::atomic<unsigned long> popped(0);
+        std::atomic<unsigned long> sum(0);
+
+        std::vector<std::thread> threads;
+        for(unsigned i = 0; i < producers; ++i)
+        {
+            threads.emplace_back([&queue, items_per_producer](){
+                for(unsigned value = 1; value <= items_per_producer; ++value) { queue.push(value); }
+            });
+        }
+        for(unsigned i = 0; i < consumers; ++i)
+        {
+            threads.emplace_back([&](){
+                unsigned value;
+                while(popped.load() < total_items)
+                {
+                    if(queue.try_pop(value))
+                    {
+                        sum += value;
+                        ++popped;
+                    }
+                    else { std::this_thread::yield(); }
+                }
+            });
+        }
+        for(std::thread& t : threads) { t.join(); }
+        sum_ok = sum_ok && sum.load() == expected_sum;
+    }, total_items);
+    std::cout << label << " sum_ok=" << sum_ok << std::endl;
+}
+
+/// Ingest pipeline: producer pushes data_chunks in batches, consumer drains them in batches.
+/// Bounded queue keeps memory constant - producer blocks when consumer cannot keep up.
+void batched_pipeline_test(bench::harness& harness, const unsigned chunks)
+{
+    static constexpr std::size_t batch_size = 64;
+    unsigned received = 0;
+    harness.run("[v5::spsc_queue] batched chunks=" + std::to_string(chunks), [&]{
+        v5::spsc_queue<data_chunk> queue(4096);
+
+        std::thread producer([&queue, chunks](){
+            std::array<data_chunk, batch_size> batch;
+            unsigned sent = 0;
+            while(sent < chunks)
+            {
+                const std::size_t wanted = std::min<std::size_t>(batch_size, chunks - sent);
+                std::generate_n(batch.begin(), wanted, prepare_data);
+                std::size_t pushed = 0;
+                while(pushed < wanted)
+                {
+                    pushed += queue.try_push_n(batch.begin() + pushed, wanted - pushed);
+                    if(pushed < wanted) { queue.push(batch[pushed++]); } ///< full - wait for consumer
+                }
+                sent += wanted;
+            }
+        });
+
+        received = 0;
+        std::array<data_chunk, batch_size> batch;
+        while(received < chunks)
+        {
+            const std::size_t popped = queue.try_pop_n(batch.begin(), batch_size);
+            if(popped == 0)
+            {
+                queue.wait_and_pop(batch[0]);
+                ++received;
+            }
+            received += popped;
+        }
+        producer.join();
+    }, chunks);
+    std::cout << "[v5::spsc_queue] batched chunks received=" << received << std::endl;
+}
+
+int main(int argc, char** argv)
 {
+    bench::harness harness("queues", argc, argv);
     // v1::threadsafe_queue<data_chunk> rq;
     // std::thread t_1(prepare_data_thread, std::ref(rq));
     // std::thread t_2(data_procesing_thread, std::ref(rq));
@@ -226,4 +930,19 @@ int main()
     std::cout << *(val.get()) << std::endl;
     val = queue_1.pop();
     std::cout << *(val.get()) << std::endl;
+
+    for(const unsigned threads : {1u, 4u, 8u})
+    {
+        producers_consumers_test<v4::threadsafe_queue<unsigned>>(harness, "[v4::threadsafe_queue]", threads, threads, 100000);
+        producers_consumers_test<v4::lock_free_queue<unsigned>>(harness, "[v4::lock_free_queue]", threads, threads, 100000);
+        producers_consumers_test<v5::mpmc_queue<unsigned>>(harness, "[v5::mpmc_queue]", threads, threads, 100000);
+    }
+
+    v4::lock_free_queue<std::string> lf_queue;
+    std::thread consumer([&lf_queue](){ std::cout << *lf_queue.wait_and_pop() << std::endl; });
+    lf_queue.push("lock-free hello");
+    consumer.join();
+
+    producers_consumers_test<v5::spsc_queue<unsigned>>(harness, "[v5::spsc_queue]", 1, 1, 100000);
+    batched_pipeline_test(harness, 1000000);
 }
\ No newline at end of file
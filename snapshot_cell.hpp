@@ -0,0 +1,188 @@
+#pragma once
+/**
+ *  snapshot_cell<T> - value read by many threads and rarely replaced. Readers always get a consistent copy of the
+ *  whole value and never block writers (and never write to memory shared with other readers).
+ *
+ *  - trivially copyable T (small configuration structs, pairs of ints): seqlock. Writer makes sequence number odd,
+ *    writes the value and makes it even again. Reader copies the value and retries when the sequence was odd or
+ *    changed during the copy.
+ *  - any other T: RCU-style pointer swap. Writer publishes new immutable copy and retires the old one, readers pin
+ *    the current copy with a hazard pointer while they look at it.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "hazard_pointer.hpp"
+
+template<typename T, bool = std::is_trivially_copyable_v<T>>
+class snapshot_cell;
+
+/// Seqlock. Value is kept in atomic words, so copying it while writer runs is not a data race - reader just sees
+/// torn value, detects it by sequence number and tries again.
+template<typename T>
+class snapshot_cell<T, true>
+{
+private:
+    static constexpr std::size_t word_count = (sizeof(T) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+
+    std::atomic<std::uint64_t> sequence;
+    std::atomic<std::uint64_t> words[word_count];
+
+    T read_words() const
+    {
+        std::uint64_t buffer[word_count];
+        for(std::size_t i = 0; i < word_count; ++i) { buffer[i] = words[i].load(std::memory_order_relaxed); }
+        T result;
+        std::memcpy(&result, buffer, sizeof(T));
+        return result;
+    }
+
+    void write_words(const T& value)
+    {
+        std::uint64_t buffer[word_count] = {};
+        std::memcpy(buffer, &value, sizeof(T));
+        for(std::size_t i = 0; i < word_count; ++i) { words[i].store(buffer[i], std::memory_order_relaxed); }
+    }
+
+    /// Writers exclude each other through the sequence number itself, returns sequence before the write
+    std::uint64_t begin_write()
+    {
+        std::uint64_t current = sequence.load(std::memory_order_relaxed);
+        while(true)
+        {
+            if(not (current & 1) &&
+               sequence.compare_exchange_weak(current, current + 1, std::memory_order_acquire, std::memory_order_relaxed))
+            {
+                std::atomic_thread_fence(std::memory_order_release); ///< odd sequence visible before new words
+                return current;
+            }
+            if(current & 1)
+            {
+                std::this_thread::yield();
+                current = sequence.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void end_write(const std::uint64_t before)
+    {
+        sequence.store(before + 2, std::memory_order_release);
+    }
+
+public:
+    explicit snapshot_cell(const T& initial = T()) : sequence(0)
+    {
+        write_words(initial);
+    }
+    snapshot_cell(const snapshot_cell&) = delete;
+    snapshot_cell& operator=(const snapshot_cell&) = delete;
+
+    T load() const
+    {
+        while(true)
+        {
+            const std::uint64_t before = sequence.load(std::memory_order_acquire);
+            if(before & 1)
+            {
+                std::this_thread::yield(); ///< writer in progress
+                continue;
+            }
+            const T result = read_words();
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(sequence.load(std::memory_order_relaxed) == before) { return result; }
+        }
+    }
+
+    /// Calls f with consistent copy of the value
+    template<typename Func>
+    decltype(auto) read(Func&& f) const
+    {
+        const T value = load();
+        return std::forward<Func>(f)(value);
+    }
+
+    void store(const T& value)
+    {
+        const std::uint64_t before = begin_write();
+        write_words(value);
+        end_write(before);
+    }
+
+    /// Read-modify-write, f gets current value by reference. Concurrent updates dont lose each other.
+    template<typename Func>
+    void update(Func&& f)
+    {
+        const std::uint64_t before = begin_write();
+        T value = read_words();
+        std::forward<Func>(f)(value);
+        write_words(value);
+        end_write(before);
+    }
+};
+
+/// RCU-style pointer swap. Every published value is immutable, store and update install new copy and retire the
+/// old one through hazard.hpp, so it is deleted only after the last reader stopped looking at it.
+template<typename T>
+class snapshot_cell<T, false>
+{
+private:
+    std::atomic<T*> current; ///< pointee is never modified after publication
+
+public:
+    explicit snapshot_cell(T initial = T()) : current(new T(std::move(initial))) {}
+    snapshot_cell(const snapshot_cell&) = delete;
+    snapshot_cell& operator=(const snapshot_cell&) = delete;
+    ~snapshot_cell()
+    {
+        delete current.load();
+    }
+
+    /// Calls f with const reference to current value. Value cannot be freed while f runs.
+    /// f must not use other containers based on hazard pointers, it would overwrite the protecting hazard pointer.
+    template<typename Func>
+    decltype(auto) read(Func&& f) const
+    {
+        std::atomic<void*>& hp = hazard::get_hazard_pointer_for_current_thread(0);
+        const T* const value = hazard::protect(hp, current);
+        struct clear_on_exit
+        {
+            std::atomic<void*>& hp;
+            ~clear_on_exit() { hp.store(nullptr); }
+        } guard{hp};
+        return std::forward<Func>(f)(*value);
+    }
+
+    T load() const
+    {
+        return read([](const T& value){ return value; });
+    }
+
+    void store(T value)
+    {
+        hazard::retire(current.exchange(new T(std::move(value))));
+    }
+
+    /// Read-copy-update, f gets private copy of current value. Retried if other writer won the race meanwhile.
+    template<typename Func>
+    void update(Func f)
+    {
+        std::atomic<void*>& hp = hazard::get_hazard_pointer_for_current_thread(0);
+        std::unique_ptr<T> new_value;
+        T* old_value;
+        do
+        {
+            old_value = hazard::protect(hp, current);
+            new_value.reset(new T(*old_value));
+            f(*new_value);
+        } while(not current.compare_exchange_strong(old_value, new_value.get()));
+        hp.store(nullptr);
+        static_cast<void>(new_value.release()); ///< owned by current now
+        hazard::retire(old_value);
+    }
+};
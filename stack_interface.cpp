@@ -7,6 +7,18 @@
 #include <memory>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <vector>
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include <functional>
+#include <algorithm>
+#include <type_traits>
+
+#include "hazard_pointer.hpp"
+#include "cache_line.hpp"
+#include "adaptive_mutex.hpp"
 
 /*
 template<typename T,typename Container=std::deque<T> >
@@ -32,34 +44,34 @@ class stack_wrapper
 {
 private:
     std::stack<T> data;
-    std::mutex m;
+    mutable std::mutex m;
 public:
     stack_wrapper(){};
     ///copy/move constructors, swap etc.
 
     bool empty() const
     {
-        std::lock_guard<std::mutex> lock(other.m);
+        std::lock_guard<std::mutex> lock(m);
         return data.empty();
     }
     size_t size() const
     {
-        std::lock_guard<std::mutex> lock(other.m);
+        std::lock_guard<std::mutex> lock(m);
         return data.size();
     }
     T& top()
     {
-        std::lock_guard<std::mutex> lock(other.m);
+        std::lock_guard<std::mutex> lock(m);
         return data.top();
     }
     void push(const T& value)
     {
-        std::lock_guard<std::mutex> lock(other.m);
+        std::lock_guard<std::mutex> lock(m);
         data.push(value);
     }
     void pop()
     {
-        std::lock_guard<std::mutex> lock(other.m);
+        std::lock_guard<std::mutex> lock(m);
         data.pop();
     }
 };
@@ -106,24 +118,24 @@ class threadsafe_stack
 {
 private:
     std::stack<T> data;
-    mutable std::mutex m;
+    mutable adaptive_mutex m{"threadsafe_stack"}; ///< critical sections are few instructions, spinning beats sleeping
 public:
     threadsafe_stack(){}
     threadsafe_stack(const threadsafe_stack& other)
     {
-        std::lock_guard<std::mutex> lock(other.m);
+        std::lock_guard<adaptive_mutex> lock(other.m);
         data=other.data;
     }
     threadsafe_stack& operator=(const threadsafe_stack&) = delete;
 
     void push(T new_value)
     {
-        std::lock_guard<std::mutex> lock(m);
+        std::lock_guard<adaptive_mutex> lock(m);
         data.push(new_value);
     }
     std::shared_ptr<T> pop()
     {
-        std::lock_guard<std::mutex> lock(m);
+        std::lock_guard<adaptive_mutex> lock(m);
         if(data.empty()) throw empty_stack();
         std::shared_ptr<T> const res(std::make_shared<T>(data.top()));
         data.pop();
@@ -131,18 +143,338 @@ public:
     }
     void pop(T& value)
     {
-        std::lock_guard<std::mutex> lock(m);
+        std::lock_guard<adaptive_mutex> lock(m);
         if(data.empty()) throw empty_stack();
         value=data.top();
         data.pop();
     }
     bool empty() const
     {
-        std::lock_guard<std::mutex> lock(m);
+        std::lock_guard<adaptive_mutex> lock(m);
         return data.empty();
     }
 };
 
+/// Treiber stack. Head is single atomic pointer, push and pop are one CAS each.
+/// Popped nodes are protected by hazard pointers: node nobody points to is recycled to thread local free list
+/// right away, otherwise it is retired and deleted once the last hazard pointer is cleared.
+template<typename T>
+class lock_free_stack
+{
+private:
+    struct node
+    {
+        T data;
+        node* next;
+        explicit node(T&& data_) : data(std::move(data_)), next(nullptr) {}
+    };
+
+    /// Nodes are interchangeable between stacks of same T, so the cache is per thread, not per stack
+    class node_cache
+    {
+    private:
+        static constexpr std::size_t max_cached = 256;
+        std::vector<node*> nodes;
+    public:
+        node_cache() { nodes.reserve(max_cached); }
+        ~node_cache() { for(node* n : nodes) { delete n; } }
+
+        node* take(T&& data)
+        {
+            if(nodes.empty()) { return new node(std::move(data)); }
+            node* const n = nodes.back();
+            nodes.pop_back();
+            n->data = std::move(data);
+            return n;
+        }
+        void give_back(node* n)
+        {
+            if(nodes.size() < max_cached) { nodes.push_back(n); }
+            else { delete n; }
+        }
+    };
+
+    static node_cache& free_nodes()
+    {
+        thread_local static node_cache cache;
+        return cache;
+    }
+
+    std::atomic<node*> head;
+
+    /// Unlinks top node. Only calling thread owns it afterwards.
+    node* pop_node()
+    {
+        std::atomic<void*>& hp = hazard::get_hazard_pointer_for_current_thread(0);
+        node* old_head = hazard::protect(hp, this->head);
+        while(old_head && not this->head.compare_exchange_strong(old_head, old_head->next))
+        {
+            old_head = hazard::protect(hp, this->head);
+        }
+        hp.store(nullptr);
+        return old_head;
+    }
+
+    void release_node(node* n)
+    {
+        if(hazard::outstanding_hazard_pointers_for(n)) { hazard::retire(n); }
+        else { free_nodes().give_back(n); }
+    }
+
+    /// Single CAS attempts, used by contention managers layered on top of the stack
+    bool try_push_node(node* new_node)
+    {
+        new_node->next = this->head.load(std::memory_order_relaxed);
+        return this->head.compare_exchange_strong(new_node->next, new_node);
+    }
+    enum class pop_status { popped, empty, contended };
+    pop_status try_pop_node(node*& popped)
+    {
+        std::atomic<void*>& hp = hazard::get_hazard_pointer_for_current_thread(0);
+        node* old_head = hazard::protect(hp, this->head);
+        pop_status status = pop_status::empty;
+        if(old_head)
+        {
+            status = this->head.compare_exchange_strong(old_head, old_head->next) ? pop_status::popped : pop_status::contended;
+        }
+        hp.store(nullptr);
+        popped = old_head;
+        return status;
+    }
+
+    template<typename> friend class elimination_backoff_stack;
+
+public:
+    lock_free_stack() : head(nullptr) {}
+    lock_free_stack(const lock_free_stack&) = delete;
+    lock_free_stack& operator=(const lock_free_stack&) = delete;
+    ~lock_free_stack()
+    {
+        node* n = this->head.load();
+        while(n)
+        {
+            node* const next = n->next;
+            delete n;
+            n = next;
+        }
+    }
+
+    void push(T new_value)
+    {
+        node* const new_node = free_nodes().take(std::move(new_value));
+        new_node->next = this->head.load(std::memory_order_relaxed);
+        while(not this->head.compare_exchange_weak(new_node->next, new_node)) {}
+    }
+
+    /// Returns false instead of throwing when stack is empty
+    bool try_pop(T& value)
+    {
+        node* const old_head = pop_node();
+        if(not old_head) { return false; }
+        value = std::move(old_head->data);
+        release_node(old_head);
+        return true;
+    }
+
+    std::shared_ptr<T> pop()
+    {
+        node* const old_head = pop_node();
+        if(not old_head) throw empty_stack();
+        std::shared_ptr<T> const res(std::make_shared<T>(std::move(old_head->data)));
+        release_node(old_head);
+        return res;
+    }
+
+    void pop(T& value)
+    {
+        if(not try_pop(value)) throw empty_stack();
+    }
+
+    bool empty() const
+    {
+        return this->head.load() == nullptr;
+    }
+};
+
+/// lock_free_stack with elimination array in front (Hendler, Shavit, Yerushalmi - "A scalable lock-free stack
+/// algorithm"). Operation first tries the head once. When it loses the CAS, instead of retrying on the same hot cache
+/// line it visits random slot of the arena: push leaves its value there for a while, pop takes value it finds.
+/// Collided push and pop cancel out and never touch the head. Backoff window doubles after every failed attempt.
+template<typename T>
+class elimination_backoff_stack
+{
+private:
+    using node = typename lock_free_stack<T>::node;
+    using pop_status = typename lock_free_stack<T>::pop_status;
+
+    /// Offer lives on pusher's stack. Pusher leaves only after taking it back from the slot or seeing it taken.
+    struct offer
+    {
+        node* value;
+        std::atomic<bool> taken{false};
+    };
+
+    lock_free_stack<T> stack;
+    const std::unique_ptr<padded<std::atomic<offer*>>[]> arena;
+    const std::size_t arena_width;
+    const unsigned min_backoff_spins;
+    const unsigned max_backoff_spins;
+
+    padded<std::atomic<unsigned long>> eliminated;
+    padded<std::atomic<unsigned long>> timed_out;
+
+    std::atomic<offer*>& random_slot()
+    {
+        thread_local static std::uint32_t state = 2463534242u ^ static_cast<std::uint32_t>(
+            std::hash<std::thread::id>()(std::this_thread::get_id()));
+        state ^= state << 13; state ^= state >> 17; state ^= state << 5; ///< xorshift32
+        return *this->arena[state % this->arena_width];
+    }
+
+    /// Returns true if some pop took the value
+    bool try_eliminate_push(node* value, const unsigned spins)
+    {
+        std::atomic<offer*>& slot = random_slot();
+        offer my_offer;
+        my_offer.value = value;
+        offer* expected = nullptr;
+        if(not slot.compare_exchange_strong(expected, &my_offer)) { return false; } ///< slot busy
+        for(unsigned i = 0; i < spins; ++i)
+        {
+            if(my_offer.taken.load(std::memory_order_acquire)) { return true; }
+            cpu_relax();
+        }
+        expected = &my_offer;
+        if(slot.compare_exchange_strong(expected, nullptr))
+        {
+            ++*this->timed_out;
+            return false;
+        }
+        /// pop removed offer from slot, wait until it is done reading it
+        while(not my_offer.taken.load(std::memory_order_acquire)) { cpu_relax(); }
+        return true;
+    }
+
+    node* try_eliminate_pop()
+    {
+        std::atomic<offer*>& slot = random_slot();
+        offer* found = slot.load();
+        if(not found || not slot.compare_exchange_strong(found, nullptr)) { return nullptr; }
+        node* const value = found->value;
+        found->taken.store(true, std::memory_order_release); ///< found must not be touched after this
+        ++*this->eliminated;
+        return value;
+    }
+
+public:
+    /// Arena slots should be about half of the threads hitting the stack at the same time
+    explicit elimination_backoff_stack(const std::size_t arena_width_ = 8,
+                                       const unsigned min_backoff_spins_ = 16, const unsigned max_backoff_spins_ = 1024) :
+        arena(new padded<std::atomic<offer*>>[std::max<std::size_t>(arena_width_, 1)]),
+        arena_width(std::max<std::size_t>(arena_width_, 1)),
+        min_backoff_spins(min_backoff_spins_),
+        max_backoff_spins(std::max(min_backoff_spins_, max_backoff_spins_)),
+        eliminated(0),
+        timed_out(0)
+    {
+        for(std::size_t i = 0; i < this->arena_width; ++i) { this->arena[i]->store(nullptr); }
+    }
+    elimination_backoff_stack(const elimination_backoff_stack&) = delete;
+    elimination_backoff_stack& operator=(const elimination_backoff_stack&) = delete;
+
+    void push(T new_value)
+    {
+        node* const new_node = lock_free_stack<T>::free_nodes().take(std::move(new_value));
+        for(unsigned spins = this->min_backoff_spins; ; spins = std::min(spins * 2, this->max_backoff_spins))
+        {
+            if(this->stack.try_push_node(new_node)) { return; }
+            if(try_eliminate_push(new_node, spins)) { return; }
+        }
+    }
+
+    bool try_pop(T& value)
+    {
+        node* popped = nullptr;
+        for(unsigned spins = this->min_backoff_spins; ; spins = std::min(spins * 2, this->max_backoff_spins))
+        {
+            const pop_status status = this->stack.try_pop_node(popped);
+            if(status == pop_status::popped)
+            {
+                value = std::move(popped->data);
+                this->stack.release_node(popped);
+                return true;
+            }
+            if(status == pop_status::empty) { return false; }
+            /// eliminated node was never published in the stack, no hazard pointer can reference it
+            if((popped = try_eliminate_pop()))
+            {
+                value = std::move(popped->data);
+                lock_free_stack<T>::free_nodes().give_back(popped);
+                return true;
+            }
+            for(unsigned i = 0; i < spins; ++i) { cpu_relax(); }
+        }
+    }
+
+    std::shared_ptr<T> pop()
+    {
+        T value;
+        if(not try_pop(value)) throw empty_stack();
+        return std::make_shared<T>(std::move(value));
+    }
+
+    void pop(T& value)
+    {
+        if(not try_pop(value)) throw empty_stack();
+    }
+
+    bool empty() const
+    {
+        return this->stack.empty();
+    }
+
+    /// Push/pop pairs which cancelled out in the arena
+    unsigned long eliminated_pairs() const { return this->eliminated->load(std::memory_order_relaxed); }
+    /// Pushes which waited in the arena and went back to the head
+    unsigned long elimination_timeouts() const { return this->timed_out->load(std::memory_order_relaxed); }
+};
+
+/// Every thread pushes and pops its own values in turns, so stack stays shallow and head is heavily contended.
+template<typename Stack>
+void stack_storm_test(const std::string& name, const unsigned thread_count, const unsigned operations_per_thread)
+{
+    Stack s;
+    std::atomic<unsigned long> sum(0);
+
+    const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for(unsigned i = 0; i < thread_count; ++i)
+    {
+        threads.emplace_back([&s, &sum, operations_per_thread](){
+            unsigned long local_sum = 0;
+            unsigned value;
+            for(unsigned op = 1; op <= operations_per_thread; ++op)
+            {
+                s.push(op);
+                s.pop(value); ///< never empty, this thread just pushed
+                local_sum += value;
+            }
+            sum += local_sum;
+        });
+    }
+    for(std::thread& t : threads) { t.join(); }
+    const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    const unsigned long expected_sum = static_cast<unsigned long>(thread_count) * operations_per_thread * (operations_per_thread + 1) / 2;
+    std::cout << name << " threads=" << thread_count << " sum_ok=" << (sum.load() == expected_sum) << " empty=" << s.empty()
+              << " time=" << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() << "[ms]";
+    if constexpr(std::is_same_v<Stack, elimination_backoff_stack<unsigned>>)
+    {
+        std::cout << " eliminated_pairs=" << s.eliminated_pairs() << " timeouts=" << s.elimination_timeouts();
+    }
+    std::cout << std::endl;
+}
+
 void example_on_threadsafe_stack()
 {
     threadsafe_stack<int> s;
@@ -158,7 +490,11 @@ void example_on_threadsafe_stack()
 
     /// Ordering threads here doesnt guarantee that t_1 will execute its function first.
     std::thread t_1(f_1, std::ref(s));
-    std::thread t_2([](threadsafe_stack<int>& s){ s.pop(); }, std::ref(s));
+    /// Loser of the race gets exception instead of undefined behaviour
+    std::thread t_2([](threadsafe_stack<int>& s){
+        try { s.pop(); }
+        catch(const empty_stack& e) { std::cout << e.what() << std::endl; }
+    }, std::ref(s));
     
     t_1.join();
     t_2.join();
@@ -167,6 +503,13 @@ void example_on_threadsafe_stack()
 
 int main()
 {
+    for(const unsigned threads : {1u, 2u, 4u, 8u})
+    {
+        stack_storm_test<threadsafe_stack<unsigned>>("[threadsafe_stack]", threads, 200000);
+        stack_storm_test<lock_free_stack<unsigned>>("[lock_free_stack]", threads, 200000);
+        stack_storm_test<elimination_backoff_stack<unsigned>>("[elimination_backoff_stack]", threads, 200000);
+    }
+
     example_on_std_stack();
     example_on_threadsafe_stack();
 }
\ No newline at end of file
@@ -0,0 +1,365 @@
+#pragma once
+/**
+ *  Work-stealing thread pool.
+ *
+ *  Every worker owns a Chase-Lev deque. Tasks submitted from a worker go to the bottom of its own deque and are
+ *  popped in LIFO order (hot in cache). Tasks submitted from other threads go to a shared injection queue.
+ *  Worker without work steals from the top of other deques, and when there is nothing to steal it parks on a
+ *  condition variable instead of spinning.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "cache_line.hpp"
+#include "unique_task.hpp"
+
+/// Queued task. Allocated from block_pool and small callables stay inline in unique_task, so posting doesnt malloc.
+struct pool_task
+{
+    unique_task run;
+    explicit pool_task(unique_task&& task) : run(std::move(task)) {}
+};
+
+/// Chase-Lev work-stealing deque (Le, Pop, Cohen, Zappa Nardelli - "Correct and efficient work-stealing for weak
+/// memory models"). Owner pushes and pops at the bottom, thieves steal from the top.
+class work_stealing_deque
+{
+private:
+    struct circular_array
+    {
+        const std::int64_t capacity;
+        const std::unique_ptr<std::atomic<pool_task*>[]> slots;
+
+        explicit circular_array(const std::int64_t capacity_) :
+            capacity(capacity_),
+            slots(new std::atomic<pool_task*>[capacity_])
+        {}
+        pool_task* get(const std::int64_t i) const
+        {
+            return this->slots[i & (this->capacity - 1)].load(std::memory_order_acquire);
+        }
+        void put(const std::int64_t i, pool_task* t)
+        {
+            this->slots[i & (this->capacity - 1)].store(t, std::memory_order_release);
+        }
+    };
+
+    padded<std::atomic<std::int64_t>> top;
+    padded<std::atomic<std::int64_t>> bottom;
+    std::atomic<circular_array*> array;
+    std::vector<std::unique_ptr<circular_array>> arrays; ///< old arrays may still be read by thieves
+
+    circular_array* grow(circular_array* old, const std::int64_t b, const std::int64_t t)
+    {
+        std::unique_ptr<circular_array> bigger(new circular_array(old->capacity * 2));
+        for(std::int64_t i = t; i < b; ++i) { bigger->put(i, old->get(i)); }
+        circular_array* const result = bigger.get();
+        this->arrays.push_back(std::move(bigger));
+        this->array.store(result, std::memory_order_release);
+        return result;
+    }
+
+public:
+    explicit work_stealing_deque(const std::int64_t capacity = 256) : top(0), bottom(0)
+    {
+        this->arrays.emplace_back(new circular_array(capacity));
+        this->array.store(this->arrays.back().get(), std::memory_order_relaxed);
+    }
+    work_stealing_deque(const work_stealing_deque&) = delete;
+    work_stealing_deque& operator=(const work_stealing_deque&) = delete;
+
+    /// owner only
+    void push(pool_task* t)
+    {
+        const std::int64_t b = this->bottom->load(std::memory_order_relaxed);
+        const std::int64_t tp = this->top->load(std::memory_order_acquire);
+        circular_array* a = this->array.load(std::memory_order_relaxed);
+        if(b - tp > a->capacity - 1) { a = grow(a, b, tp); }
+        a->put(b, t);
+        std::atomic_thread_fence(std::memory_order_release);
+        this->bottom->store(b + 1, std::memory_order_relaxed);
+    }
+
+    /// owner only
+    pool_task* pop()
+    {
+        const std::int64_t b = this->bottom->load(std::memory_order_relaxed) - 1;
+        circular_array* const a = this->array.load(std::memory_order_relaxed);
+        this->bottom->store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::int64_t t = this->top->load(std::memory_order_relaxed);
+
+        if(t > b)
+        {
+            this->bottom->store(b + 1, std::memory_order_relaxed); ///< deque was empty
+            return nullptr;
+        }
+        pool_task* task = a->get(b);
+        if(t == b)
+        {
+            /// last element - race with thieves
+            if(not this->top->compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                task = nullptr;
+            }
+            this->bottom->store(b + 1, std::memory_order_relaxed);
+        }
+        return task;
+    }
+
+    /// any thread
+    pool_task* steal()
+    {
+        std::int64_t t = this->top->load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const std::int64_t b = this->bottom->load(std::memory_order_acquire);
+        if(t >= b) { return nullptr; }
+
+        circular_array* const a = this->array.load(std::memory_order_acquire);
+        pool_task* const task = a->get(t);
+        if(not this->top->compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            return nullptr; ///< lost race with other thief or owner
+        }
+        return task;
+    }
+
+    bool empty() const
+    {
+        return this->bottom->load(std::memory_order_relaxed) <= this->top->load(std::memory_order_relaxed);
+    }
+};
+
+class thread_pool
+{
+private:
+    struct worker
+    {
+        work_stealing_deque tasks;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<worker>> workers;
+
+    std::mutex injection_mutex;
+    std::deque<pool_task*> injection_queue;
+    std::atomic<std::size_t> injected;
+
+    std::mutex park_mutex;
+    std::condition_variable park_cond;
+    std::atomic<unsigned> parked;
+    std::atomic<bool> done;
+
+    /// worker index of current thread, valid only if current_pool() == this
+    static unsigned& current_index()
+    {
+        thread_local static unsigned index = 0;
+        return index;
+    }
+    static thread_pool*& current_pool()
+    {
+        thread_local static thread_pool* pool = nullptr;
+        return pool;
+    }
+
+    pool_task* pop_injected()
+    {
+        if(this->injected.load(std::memory_order_relaxed) == 0) { return nullptr; }
+        std::lock_guard<std::mutex> lock(injection_mutex);
+        if(this->injection_queue.empty()) { return nullptr; }
+        pool_task* const task = this->injection_queue.front();
+        this->injection_queue.pop_front();
+        --this->injected;
+        return task;
+    }
+
+    pool_task* steal(const unsigned thief)
+    {
+        const unsigned count = static_cast<unsigned>(this->workers.size());
+        for(unsigned i = 1; i <= count; ++i)
+        {
+            if(pool_task* const task = this->workers[(thief + i) % count]->tasks.steal()) { return task; }
+        }
+        return nullptr;
+    }
+
+    pool_task* find_task()
+    {
+        if(current_pool() == this)
+        {
+            const unsigned index = current_index();
+            if(pool_task* const task = this->workers[index]->tasks.pop()) { return task; }
+            if(pool_task* const task = pop_injected()) { return task; }
+            return steal(index);
+        }
+        if(pool_task* const task = pop_injected()) { return task; }
+        return steal(0);
+    }
+
+    bool has_work() const
+    {
+        if(this->injected.load() != 0) { return true; }
+        for(const std::unique_ptr<worker>& w : this->workers)
+        {
+            if(not w->tasks.empty()) { return true; }
+        }
+        return false;
+    }
+
+    static void execute(pool_task* task)
+    {
+        struct release_on_exit
+        {
+            pool_task* task;
+            ~release_on_exit() { pool_delete(task); }
+        } owner{task};
+        task->run();
+    }
+
+    void park()
+    {
+        std::unique_lock<std::mutex> lock(park_mutex);
+        ++this->parked;
+        std::atomic_thread_fence(std::memory_order_seq_cst); ///< pairs with fence in wake_one()
+        this->park_cond.wait(lock, [this]{ return this->done.load() || has_work(); });
+        --this->parked;
+    }
+
+    void wake_one()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(this->parked.load(std::memory_order_relaxed) == 0) { return; }
+        std::lock_guard<std::mutex> lock(park_mutex);
+        this->park_cond.notify_one();
+    }
+
+    void worker_thread(const unsigned index)
+    {
+        current_pool() = this;
+        current_index() = index;
+        while(not this->done.load())
+        {
+            if(pool_task* const task = find_task()) { execute(task); }
+            else { park(); }
+        }
+    }
+
+    void enqueue(pool_task* task)
+    {
+        if(current_pool() == this) { this->workers[current_index()]->tasks.push(task); }
+        else
+        {
+            std::lock_guard<std::mutex> lock(injection_mutex);
+            this->injection_queue.push_back(task);
+            ++this->injected;
+        }
+        wake_one();
+    }
+
+public:
+    explicit thread_pool(unsigned thread_count = std::thread::hardware_concurrency()) :
+        injected(0),
+        parked(0),
+        done(false)
+    {
+        if(thread_count == 0) { thread_count = 2; }
+        for(unsigned i = 0; i < thread_count; ++i) { this->workers.emplace_back(new worker); }
+        for(unsigned i = 0; i < thread_count; ++i)
+        {
+            this->workers[i]->thread = std::thread(&thread_pool::worker_thread, this, i);
+        }
+    }
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    ~thread_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(park_mutex);
+            this->done = true;
+        }
+        this->park_cond.notify_all();
+        for(std::unique_ptr<worker>& w : this->workers) { w->thread.join(); }
+
+        /// drop tasks which never run, their futures get broken_promise
+        while(pool_task* const task = pop_injected()) { pool_delete(task); }
+        for(std::unique_ptr<worker>& w : this->workers)
+        {
+            while(pool_task* const task = w->tasks.steal()) { pool_delete(task); }
+        }
+    }
+
+    unsigned size() const { return static_cast<unsigned>(this->workers.size()); }
+
+    /// Runs f on the pool. Returned future becomes ready when f finishes.
+    template<typename Func>
+    std::future<std::invoke_result_t<Func>> submit(Func f)
+    {
+        using result_type = std::invoke_result_t<Func>;
+        std::packaged_task<result_type()> task(std::move(f));
+        std::future<result_type> res(task.get_future());
+        post(std::move(task));
+        return res;
+    }
+
+    /// Same as submit, but result is delivered through pooled task_future - no heap allocation for callables up to
+    /// 48 bytes
+    template<typename Func>
+    task_future<std::invoke_result_t<Func>> submit_task(Func f)
+    {
+        packaged<std::invoke_result_t<Func>> task = package_task(std::move(f));
+        post(std::move(task.task));
+        return std::move(task.future);
+    }
+
+    /// Runs f on the pool without creating a future
+    template<typename Func>
+    void post(Func f)
+    {
+        enqueue(pool_new<pool_task>(unique_task(std::move(f))));
+    }
+
+    /// Runs one queued task on the calling thread. Returns false if there was nothing to run.
+    bool run_pending_task()
+    {
+        pool_task* const task = find_task();
+        if(not task) { return false; }
+        execute(task);
+        return true;
+    }
+
+    /// Waits for future, executing other tasks in the meantime instead of blocking the thread
+    template<typename T>
+    void wait(const std::future<T>& f)
+    {
+        while(f.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            if(not run_pending_task()) { f.wait_for(std::chrono::microseconds(100)); }
+        }
+    }
+    template<typename T>
+    void wait(const task_future<T>& f)
+    {
+        while(not f.is_ready())
+        {
+            if(not run_pending_task()) { f.wait_for(std::chrono::microseconds(100)); }
+        }
+    }
+};
+
+/// Process-wide pool shared by algorithms which dont want to manage their own threads
+inline thread_pool& default_thread_pool()
+{
+    static thread_pool pool;
+    return pool;
+}
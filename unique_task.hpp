@@ -0,0 +1,606 @@
+#pragma once
+/**
+ *  Allocation-free tasks.
+ *
+ *  std::function + std::packaged_task + std::future cost at least two heap allocations per task (callable and shared
+ *  state), plus whatever the queue allocates. At millions of tasks per second malloc/free dominates the profile.
+ *
+ *  - block_pool:    fixed size blocks recycled through thread local free lists. Blocks freed on other thread than
+ *                   they were allocated on (producer/consumer queues) travel back in batches via a global depot,
+ *                   so the depot mutex is taken once per batch_size operations.
+ *  - unique_task:   move-only void() callable with 64 bytes of inline storage. Callables which fit are stored
+ *                   without any allocation, bigger ones go to the heap.
+ *  - task_promise / task_future: one-shot result channel. Shared state comes from block_pool and waiting uses futex.
+ *  - package_task:  packaged_task replacement returning unique_task and its task_future.
+ *  - then / when_all / when_any: continuations (Concurrency TS style). Ready future triggers a callback which posts
+ *                   the continuation to an executor, so fan-out/fan-in needs no thread blocked in get().
+ */
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <memory>
+#include <new>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "futex.hpp"
+
+template<std::size_t Size, std::size_t Align>
+class block_pool
+{
+private:
+    static_assert(Align <= alignof(std::max_align_t), "over-aligned blocks are not supported");
+    static constexpr std::size_t block_size = Size < sizeof(void*) ? sizeof(void*) : Size;
+    static constexpr std::size_t batch_size = 32;
+
+    struct free_block
+    {
+        free_block* next;
+    };
+
+    /// Batches of free blocks shared by all threads
+    class depot
+    {
+    private:
+        std::mutex m;
+        std::vector<free_block*> batches; ///< each is a list of up to batch_size blocks
+    public:
+        void put(free_block* batch)
+        {
+            std::lock_guard<std::mutex> lock(m);
+            batches.push_back(batch);
+        }
+        free_block* take()
+        {
+            std::lock_guard<std::mutex> lock(m);
+            if(batches.empty()) { return nullptr; }
+            free_block* const batch = batches.back();
+            batches.pop_back();
+            return batch;
+        }
+    };
+
+    struct local_cache
+    {
+        free_block* head = nullptr;
+        std::size_t count = 0;
+        ~local_cache()
+        {
+            if(head) { global_depot().put(head); }
+            cache_alive() = false;
+        }
+    };
+
+    /// Never destroyed - threads (eg. workers of a static pool) may return their caches after static destructors ran
+    static depot& global_depot()
+    {
+        static depot* const d = new depot;
+        return *d;
+    }
+
+    /// Blocks released during static destruction, after thread local cache is gone, go straight to the heap
+    static bool& cache_alive()
+    {
+        thread_local static bool alive = true;
+        return alive;
+    }
+
+    static local_cache& cache()
+    {
+        thread_local static local_cache c;
+        return c;
+    }
+
+public:
+    static void* allocate()
+    {
+        if(not cache_alive()) { return ::operator new(block_size); }
+        local_cache& c = cache();
+        if(not c.head)
+        {
+            c.head = global_depot().take();
+            c.count = 0;
+            for(free_block* b = c.head; b; b = b->next) { ++c.count; }
+            if(not c.head) { return ::operator new(block_size); }
+        }
+        free_block* const block = c.head;
+        c.head = block->next;
+        --c.count;
+        return block;
+    }
+
+    static void deallocate(void* p)
+    {
+        if(not cache_alive())
+        {
+            ::operator delete(p);
+            return;
+        }
+        local_cache& c = cache();
+        free_block* const block = static_cast<free_block*>(p);
+        block->next = c.head;
+        c.head = block;
+        if(++c.count < 2 * batch_size) { return; }
+
+        /// hand one batch over to threads which allocate more than they free
+        free_block* batch = c.head;
+        free_block* last = batch;
+        for(std::size_t i = 1; i < batch_size; ++i) { last = last->next; }
+        c.head = last->next;
+        last->next = nullptr;
+        c.count -= batch_size;
+        global_depot().put(batch);
+    }
+};
+
+/// block_pool sized for T
+template<typename T>
+using pool_for = block_pool<sizeof(T), alignof(T)>;
+
+template<typename T, typename... Args>
+T* pool_new(Args&&... args)
+{
+    void* const memory = pool_for<T>::allocate();
+    try
+    {
+        return new(memory) T(std::forward<Args>(args)...);
+    }
+    catch(...)
+    {
+        pool_for<T>::deallocate(memory);
+        throw;
+    }
+}
+
+template<typename T>
+void pool_delete(T* object)
+{
+    object->~T();
+    pool_for<T>::deallocate(object);
+}
+
+/// Move-only void() callable. Callables up to inline_capacity bytes (and nothrow movable) live inside the object.
+class unique_task
+{
+public:
+    static constexpr std::size_t inline_capacity = 64;
+
+private:
+    struct operations
+    {
+        void (*invoke)(void* storage);
+        void (*move_to)(void* from, void* to) noexcept; ///< move constructs into to and destroys from
+        void (*destroy)(void* storage) noexcept;
+    };
+
+    template<typename Func>
+    static constexpr bool fits_inline = sizeof(Func) <= inline_capacity &&
+                                        alignof(Func) <= alignof(std::max_align_t) &&
+                                        std::is_nothrow_move_constructible_v<Func>;
+
+    template<typename Func>
+    static constexpr operations inline_operations{
+        [](void* storage){ (*static_cast<Func*>(storage))(); },
+        [](void* from, void* to) noexcept {
+            new(to) Func(std::move(*static_cast<Func*>(from)));
+            static_cast<Func*>(from)->~Func();
+        },
+        [](void* storage) noexcept { static_cast<Func*>(storage)->~Func(); }
+    };
+
+    template<typename Func>
+    static constexpr operations heap_operations{
+        [](void* storage){ (**static_cast<Func**>(storage))(); },
+        [](void* from, void* to) noexcept { *static_cast<Func**>(to) = *static_cast<Func**>(from); },
+        [](void* storage) noexcept { delete *static_cast<Func**>(storage); }
+    };
+
+    alignas(std::max_align_t) unsigned char storage[inline_capacity];
+    const operations* ops;
+
+    void reset() noexcept
+    {
+        if(ops) { ops->destroy(storage); }
+        ops = nullptr;
+    }
+
+public:
+    unique_task() noexcept : ops(nullptr) {}
+
+    template<typename Func, typename = std::enable_if_t<not std::is_same_v<std::decay_t<Func>, unique_task>>>
+    unique_task(Func&& f) : ops(nullptr)
+    {
+        using func_type = std::decay_t<Func>;
+        if constexpr(fits_inline<func_type>)
+        {
+            new(storage) func_type(std::forward<Func>(f));
+            ops = &inline_operations<func_type>;
+        }
+        else
+        {
+            *reinterpret_cast<func_type**>(storage) = new func_type(std::forward<Func>(f));
+            ops = &heap_operations<func_type>;
+        }
+    }
+
+    unique_task(unique_task&& other) noexcept : ops(other.ops)
+    {
+        if(ops) { ops->move_to(other.storage, storage); }
+        other.ops = nullptr;
+    }
+    unique_task& operator=(unique_task&& other) noexcept
+    {
+        if(this != &other)
+        {
+            reset();
+            ops = other.ops;
+            if(ops) { ops->move_to(other.storage, storage); }
+            other.ops = nullptr;
+        }
+        return *this;
+    }
+    unique_task(const unique_task&) = delete;
+    unique_task& operator=(const unique_task&) = delete;
+    ~unique_task() { reset(); }
+
+    explicit operator bool() const noexcept { return ops != nullptr; }
+
+    void operator()() { ops->invoke(storage); }
+};
+
+/// Shared state of task_promise/task_future, allocated from block_pool
+template<typename T>
+class task_state
+{
+private:
+    enum : int { pending = 0, waiting = 1, ready = 2 };
+    enum : int { no_callback = 0, has_callback = 1, callback_fired = 2, callback_busy = 3 };
+
+    using value_type = std::conditional_t<std::is_void_v<T>, char, T>;
+
+    std::atomic<int> status;
+    std::atomic<int> references;
+    std::atomic<int> callback_status;
+    std::optional<value_type> value;
+    std::exception_ptr error;
+    unique_task callback;
+
+    /// Takes the callback slot: returns previous status, or callback_fired when the state is already ready
+    int lock_callback(const int target)
+    {
+        int current = callback_status.load(std::memory_order_acquire);
+        while(true)
+        {
+            if(current == callback_fired) { return current; }
+            if(current == callback_busy)
+            {
+                std::this_thread::yield();
+                current = callback_status.load(std::memory_order_acquire);
+                continue;
+            }
+            if(callback_status.compare_exchange_weak(current, target, std::memory_order_acq_rel)) { return current; }
+        }
+    }
+
+    void publish()
+    {
+        if(status.exchange(ready, std::memory_order_acq_rel) == waiting) { futex_wake(status, INT_MAX); }
+        if(lock_callback(callback_fired) == has_callback)
+        {
+            unique_task ready_callback(std::move(callback));
+            ready_callback();
+        }
+    }
+
+public:
+    task_state() : status(pending), references(2), callback_status(no_callback) {}
+
+    /// Runs f once the state is ready - on the thread which makes it ready, or right now if it already is.
+    /// Callbacks registered before that run in registration order.
+    void on_ready(unique_task f)
+    {
+        const int previous = lock_callback(callback_busy);
+        if(previous == callback_fired)
+        {
+            f();
+            return;
+        }
+        if(previous == has_callback)
+        {
+            callback = unique_task([first = std::move(callback), second = std::move(f)]() mutable {
+                first();
+                second();
+            });
+        }
+        else { callback = std::move(f); }
+        callback_status.store(has_callback, std::memory_order_release);
+    }
+
+    bool is_ready() const { return status.load(std::memory_order_acquire) == ready; }
+
+    void wait()
+    {
+        int current = status.load(std::memory_order_acquire);
+        while(current != ready)
+        {
+            if(current == pending &&
+               not status.compare_exchange_weak(current, waiting, std::memory_order_acquire)) { continue; }
+            futex_wait(status, waiting);
+            current = status.load(std::memory_order_acquire);
+        }
+    }
+
+    /// Returns true if state became ready within timeout
+    bool wait_for(const std::chrono::nanoseconds timeout)
+    {
+        int current = status.load(std::memory_order_acquire);
+        if(current == pending) { status.compare_exchange_strong(current, waiting, std::memory_order_acquire); }
+        if(current != ready) { futex_wait_for(status, waiting, timeout); }
+        return is_ready();
+    }
+
+    template<typename... Args>
+    void set_value(Args&&... args)
+    {
+        value.emplace(std::forward<Args>(args)...);
+        publish();
+    }
+
+    void set_exception(std::exception_ptr e)
+    {
+        error = std::move(e);
+        publish();
+    }
+
+    T get()
+    {
+        wait();
+        if(error) { std::rethrow_exception(error); }
+        if constexpr(not std::is_void_v<T>) { return std::move(*value); }
+    }
+
+    void release()
+    {
+        if(references.fetch_sub(1, std::memory_order_acq_rel) == 1) { pool_delete(this); }
+    }
+};
+
+template<typename T>
+class task_promise;
+
+template<typename Func, typename Result>
+void fulfil(task_promise<Result>& promise, Func& f);
+
+template<typename T>
+class task_future
+{
+private:
+    task_state<T>* state;
+
+public:
+    task_future() noexcept : state(nullptr) {}
+    explicit task_future(task_state<T>* state_) noexcept : state(state_) {}
+    task_future(task_future&& other) noexcept : state(std::exchange(other.state, nullptr)) {}
+    task_future& operator=(task_future&& other) noexcept
+    {
+        if(this != &other)
+        {
+            if(state) { state->release(); }
+            state = std::exchange(other.state, nullptr);
+        }
+        return *this;
+    }
+    task_future(const task_future&) = delete;
+    task_future& operator=(const task_future&) = delete;
+    ~task_future()
+    {
+        if(state) { state->release(); }
+    }
+
+    bool valid() const noexcept { return state != nullptr; }
+    bool is_ready() const { return state->is_ready(); }
+    void wait() const { state->wait(); }
+    template<typename Rep, typename Period>
+    bool wait_for(const std::chrono::duration<Rep, Period>& timeout) const
+    {
+        return state->wait_for(std::chrono::duration_cast<std::chrono::nanoseconds>(timeout));
+    }
+
+    /// One-shot like std::future::get, future is invalid afterwards
+    T get()
+    {
+        task_future owner(std::move(*this));
+        return owner.state->get();
+    }
+
+    /// Low level hook - f runs on the thread which completes the future (or right now), so it has to be short
+    void on_ready(unique_task f) const { state->on_ready(std::move(f)); }
+
+    /// Concurrency TS style continuation: once this future is ready, f(ready future) is posted to executor and its
+    /// result is delivered through the returned future. Nobody blocks in get() meanwhile. This future is invalid
+    /// afterwards. Executor is anything with post(callable) (thread_pool, gui_event_loop ...) and has to outlive
+    /// the continuation.
+    template<typename Executor, typename Func>
+    task_future<std::invoke_result_t<Func, task_future<T>>> then(Executor& executor, Func f)
+    {
+        using result_type = std::invoke_result_t<Func, task_future<T>>;
+        task_promise<result_type> promise;
+        task_future<result_type> result = promise.get_future();
+        task_state<T>* const source = state;
+        source->on_ready(unique_task(
+            [&executor, f = std::move(f), promise = std::move(promise), self = std::move(*this)]() mutable {
+                executor.post([f = std::move(f), promise = std::move(promise), self = std::move(self)]() mutable {
+                    auto continuation = [&f, &self]{ return f(std::move(self)); };
+                    fulfil(promise, continuation);
+                });
+            }));
+        return result;
+    }
+};
+
+template<typename T>
+class task_promise
+{
+private:
+    task_state<T>* state;
+    bool future_retrieved;
+    bool satisfied;
+
+public:
+    task_promise() : state(pool_new<task_state<T>>()), future_retrieved(false), satisfied(false) {}
+    task_promise(task_promise&& other) noexcept :
+        state(std::exchange(other.state, nullptr)),
+        future_retrieved(other.future_retrieved),
+        satisfied(other.satisfied)
+    {}
+    task_promise& operator=(task_promise&&) = delete;
+    task_promise(const task_promise&) = delete;
+    task_promise& operator=(const task_promise&) = delete;
+    ~task_promise()
+    {
+        if(not state) { return; }
+        if(not satisfied)
+        {
+            state->set_exception(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+        }
+        if(not future_retrieved) { state->release(); } ///< reference held for the future nobody took
+        state->release();
+    }
+
+    task_future<T> get_future()
+    {
+        if(future_retrieved) { throw std::future_error(std::future_errc::future_already_retrieved); }
+        future_retrieved = true;
+        return task_future<T>(state);
+    }
+
+    template<typename... Args>
+    void set_value(Args&&... args)
+    {
+        satisfied = true;
+        state->set_value(std::forward<Args>(args)...);
+    }
+
+    void set_exception(std::exception_ptr e)
+    {
+        satisfied = true;
+        state->set_exception(std::move(e));
+    }
+};
+
+/// Runs f and stores its result or exception in promise
+template<typename Func, typename Result>
+void fulfil(task_promise<Result>& promise, Func& f)
+{
+    try
+    {
+        if constexpr(std::is_void_v<Result>)
+        {
+            f();
+            promise.set_value();
+        }
+        else { promise.set_value(f()); }
+    }
+    catch(...)
+    {
+        promise.set_exception(std::current_exception());
+    }
+}
+
+template<typename Result>
+struct packaged
+{
+    unique_task task;
+    task_future<Result> future;
+};
+
+/// std::packaged_task replacement. Task stays inline when f takes up to 48 bytes (promise takes the rest).
+template<typename Func>
+packaged<std::invoke_result_t<Func>> package_task(Func f)
+{
+    using result_type = std::invoke_result_t<Func>;
+    task_promise<result_type> promise;
+    task_future<result_type> future = promise.get_future();
+    unique_task task([promise = std::move(promise), f = std::move(f)]() mutable { fulfil(promise, f); });
+    return packaged<result_type>{std::move(task), std::move(future)};
+}
+
+/// Ready when all futures are, they are handed back ready (values or exceptions inside). No thread waits for them.
+template<typename T>
+task_future<std::vector<task_future<T>>> when_all(std::vector<task_future<T>> futures)
+{
+    struct shared
+    {
+        std::atomic<std::size_t> remaining;
+        std::vector<task_future<T>> futures;
+        task_promise<std::vector<task_future<T>>> promise;
+
+        void arrive()
+        {
+            if(remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) { promise.set_value(std::move(futures)); }
+        }
+    };
+    const auto all = std::make_shared<shared>();
+    all->remaining.store(futures.size() + 1, std::memory_order_relaxed); ///< +1 keeps vector in place while we register
+    all->futures = std::move(futures);
+    task_future<std::vector<task_future<T>>> result = all->promise.get_future();
+    for(const task_future<T>& f : all->futures) { f.on_ready(unique_task([all]{ all->arrive(); })); }
+    all->arrive();
+    return result;
+}
+
+template<typename T>
+struct when_any_result
+{
+    std::size_t index; ///< first future which became ready, SIZE_MAX for empty input
+    std::vector<task_future<T>> futures;
+};
+
+/// Ready when any of futures is. The others keep running and can still be waited for or continued.
+template<typename T>
+task_future<when_any_result<T>> when_any(std::vector<task_future<T>> futures)
+{
+    struct shared
+    {
+        std::atomic<bool> decided{false};
+        std::atomic<int> gate{2}; ///< winner and registration loop - whoever comes last publishes
+        std::size_t index = SIZE_MAX;
+        std::vector<task_future<T>> futures;
+        task_promise<when_any_result<T>> promise;
+
+        void pass()
+        {
+            if(gate.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                promise.set_value(when_any_result<T>{index, std::move(futures)});
+            }
+        }
+    };
+    const auto any = std::make_shared<shared>();
+    any->futures = std::move(futures);
+    task_future<when_any_result<T>> result = any->promise.get_future();
+    if(any->futures.empty())
+    {
+        any->promise.set_value(when_any_result<T>{SIZE_MAX, {}});
+        return result;
+    }
+    for(std::size_t i = 0; i < any->futures.size(); ++i)
+    {
+        any->futures[i].on_ready(unique_task([any, i]{
+            if(any->decided.exchange(true, std::memory_order_acq_rel)) { return; }
+            any->index = i;
+            any->pass();
+        }));
+    }
+    any->pass();
+    return result;
+}